@@ -0,0 +1,345 @@
+/*
+ * append.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: simonenkos
+ */
+
+#ifndef APPEND_HPP_
+#define APPEND_HPP_
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#include "cancellation.hpp"
+#include "copy.hpp"
+#include "digest.hpp"
+#include "file_io.hpp"
+#include "mapped_file.hpp"
+#include "output_format.hpp"
+#include "sigdiff.hpp"
+
+namespace
+{
+
+// Time of waiting for changes of a followed input between checks of cancellation.
+constexpr int FOLLOW_POLL_TIMEOUT_MS = 200;
+
+}
+
+/**
+ * Place of a grown input where its previous signature is continued from.
+ */
+struct append_point
+{
+   hash_algorithm algorithm;
+   uint64_t block_size;
+   // Number of full blocks of the previous signature, which are kept. A partial block
+   // after them is hashed again, since the input may have grown into it.
+   uint64_t blocks;
+};
+
+/**
+ * Finds where a previous signature of the sig format is continued from for an input
+ * which has grown since. The signature must still describe the beginning of the input:
+ * the input isn't shorter than the part it covers and its last full block has the same
+ * digest, so an input which has been rotated or rewritten isn't appended to.
+ * Returns an empty string or a description of a problem.
+ */
+inline std::string find_append_point(const std::string & signature_name, const std::string & input_name, append_point & point)
+{
+   mapped_file file;
+   signature_header header;
+   std::string error = open_signature(signature_name, file, header);
+
+   if (!error.empty()) return error;
+   if (header.flags & SIGNATURE_SHARD) return signature_name + ": shards of a signature have to be merged to be appended to";
+
+   point.algorithm  = static_cast<hash_algorithm>(header.algorithm);
+   point.block_size = header.block_size;
+   point.blocks     = std::min(header.block_count, header.covered_size / header.block_size);
+
+   int fd = ::open(input_name.c_str(), O_RDONLY | O_CLOEXEC);
+   struct stat st;
+
+   if (fd == -1 || fstat(fd, &st) != 0)
+   {
+      error = input_name + ": " + std::strerror(errno);
+      if (fd != -1) ::close(fd);
+      return error;
+   }
+   if (static_cast<uint64_t>(st.st_size) < header.covered_size)
+   {
+      ::close(fd);
+      return input_name + ": input file is shorter than its signature, it has been truncated or replaced";
+   }
+   if (point.blocks == 0)
+   {
+      ::close(fd);
+      return std::string();
+   }
+
+   block_buffer buffer(point.block_size, 0);
+   bool readed = read_block_at(fd, buffer.data(), buffer.size(), (point.blocks - 1) * point.block_size);
+
+   if (!readed) error = input_name + ": " + std::strerror(errno);
+   ::close(fd);
+   if (!readed) return error;
+
+   const block_hasher hasher { point.algorithm, point.block_size };
+   const uint8_t * data = reinterpret_cast<const uint8_t *>(buffer.data());
+   size_t size = buffer.size();
+   block_digest digest;
+
+   hasher.hash(&data, &size, 1, &digest);
+
+   if (std::memcmp(digest.bytes, file.data() + sizeof(header) + (point.blocks - 1) * header.digest_size, header.digest_size) != 0)
+      return input_name + ": input file doesn't begin with data of its signature, it has been replaced";
+
+   return std::string();
+}
+
+/**
+ * Opens an output which continues a previous signature: the signature itself, which
+ * is cut after its full blocks later, or a new file which gets them copied.
+ */
+inline bool open_append_output(const std::string & signature_name, const std::string & output_name, const append_point & point,
+                               std::ofstream & output)
+{
+   struct stat signature_stat, output_stat;
+
+   if (stat(signature_name.c_str(), &signature_stat) == 0 && stat(output_name.c_str(), &output_stat) == 0 &&
+       signature_stat.st_dev == output_stat.st_dev && signature_stat.st_ino == output_stat.st_ino)
+   {
+      output.open(output_name, std::ios::binary | std::ios::in | std::ios::out);
+      return output.is_open();
+   }
+
+   mapped_file file;
+
+   if (!file.open(signature_name, MADV_SEQUENTIAL)) return false;
+
+   output.open(output_name, std::ios::binary | std::ios::trunc);
+   output.write(reinterpret_cast<const char *>(file.data()), sizeof(signature_header) + point.blocks * digest_size(point.algorithm));
+   return output.good();
+}
+
+/**
+ * Cuts a signature file, which has been resumed by a writer, after its kept blocks.
+ */
+inline bool cut_signature(const std::string & name, const append_point & point)
+{
+   return ::truncate(name.c_str(), sizeof(signature_header) + point.blocks * digest_size(point.algorithm)) == 0;
+}
+
+/**
+ * Keeps a signature of a growing input up to date. Writes to the input are watched with
+ * inotify, blocks appended since the last round are hashed and the signature is rewritten
+ * from its last full block, so after each round it's a complete signature of the input.
+ * Appended data is usually small, so it's hashed on the calling thread, as a small input is.
+ */
+class input_follower
+{
+   std::string input_name_;
+   std::string signature_name_;
+   int input_fd_;
+   int inotify_fd_;
+   append_point point_;
+   uint64_t covered_size_;
+
+public:
+   input_follower(const std::string & input_name, const std::string & signature_name)
+      : input_name_(input_name), signature_name_(signature_name), input_fd_(-1), inotify_fd_(-1), point_(),
+        covered_size_(0)
+   { }
+   input_follower(const input_follower &) = delete;
+   input_follower & operator=(const input_follower &) = delete;
+
+   ~input_follower()
+   {
+      if (input_fd_ != -1) ::close(input_fd_);
+      if (inotify_fd_ != -1) ::close(inotify_fd_);
+   }
+
+   // Starts watching the input, which has a complete signature. Returns an empty string or a problem.
+   std::string open()
+   {
+      mapped_file file;
+      signature_header header;
+      std::string error = find_append_point(signature_name_, input_name_, point_);
+
+      if (error.empty()) error = open_signature(signature_name_, file, header);
+      if (!error.empty()) return error;
+
+      covered_size_ = header.covered_size;
+      input_fd_     = ::open(input_name_.c_str(), O_RDONLY | O_CLOEXEC);
+      inotify_fd_   = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+
+      // Removal of the input is seen by a change of its links, it's not deleted while it's open.
+      if (input_fd_ == -1 || inotify_fd_ == -1 ||
+          inotify_add_watch(inotify_fd_, input_name_.c_str(), IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVE_SELF) == -1)
+         return input_name_ + ": " + std::strerror(errno);
+
+      return std::string();
+   }
+
+   // Waits for the input to be changed. Returns false when following is over: it has been
+   // cancelled, or the input has been moved away or removed, which is told by a reason.
+   bool wait(std::string & reason)
+   {
+      alignas(inotify_event) char events[4096];
+
+      while (!cancel_requested())
+      {
+         pollfd descriptor { inotify_fd_, POLLIN, 0 };
+
+         if (poll(&descriptor, 1, FOLLOW_POLL_TIMEOUT_MS) <= 0) continue;
+
+         bool changed = false;
+         ssize_t size;
+
+         // All events which have been queued are taken at once, a round covers them all.
+         while ((size = ::read(inotify_fd_, events, sizeof(events))) > 0)
+         {
+            for (char * position = events; position < events + size; )
+            {
+               const inotify_event * event = reinterpret_cast<const inotify_event *>(position);
+               struct stat st;
+
+               if ((event->mask & (IN_MOVE_SELF | IN_IGNORED)) ||
+                   ((event->mask & IN_ATTRIB) && fstat(input_fd_, &st) == 0 && st.st_nlink == 0))
+               {
+                  reason = "input file has been moved or removed";
+                  return false;
+               }
+               changed = changed || (event->mask & (IN_MODIFY | IN_CLOSE_WRITE));
+               position += sizeof(inotify_event) + event->len;
+            }
+         }
+         if (changed) return true;
+      }
+      return false;
+   }
+
+   // Hashes blocks appended since the last round and the partial block before them, and rewrites
+   // the signature from there. Returns false if the input doesn't continue its signature anymore.
+   bool update(std::string & error)
+   {
+      struct stat st;
+
+      if (fstat(input_fd_, &st) != 0)
+      {
+         error = std::strerror(errno);
+         return false;
+      }
+
+      const uint64_t size = st.st_size;
+
+      if (size < covered_size_)
+      {
+         error = "input file has been truncated";
+         return false;
+      }
+      if (size == covered_size_) return true;
+
+      const block_hasher hasher { point_.algorithm, point_.block_size };
+      const size_t blocks_per_task = hasher.blocks_per_task();
+      const uint64_t block_count = (size + point_.block_size - 1) / point_.block_size;
+      std::vector<block_buffer> buffers(blocks_per_task, block_buffer(point_.block_size, 0));
+      std::vector<block_result> results;
+
+      for (uint64_t first = point_.blocks; first < block_count; first += blocks_per_task)
+      {
+         const uint8_t * data[DIGEST_BATCH_SIZE];
+         size_t sizes[DIGEST_BATCH_SIZE];
+         block_digest digests[DIGEST_BATCH_SIZE];
+         size_t count = std::min<uint64_t>(blocks_per_task, block_count - first);
+
+         for (size_t i = 0; i < count; i++)
+         {
+            uint64_t offset = (first + i) * point_.block_size;
+
+            sizes[i] = std::min<uint64_t>(point_.block_size, size - offset);
+            data[i]  = reinterpret_cast<const uint8_t *>(buffers[i].data());
+
+            if (!read_block_at(input_fd_, buffers[i].data(), sizes[i], offset))
+            {
+               error = std::strerror(errno);
+               return false;
+            }
+         }
+
+         hasher.hash(data, sizes, count, digests);
+
+         for (size_t i = 0; i < count; i++)
+            results.push_back({ digests[i], sizes[i] });
+      }
+
+      std::ofstream output { signature_name_, std::ios::binary | std::ios::in | std::ios::out };
+      signature_writer writer { output, output_format::sig, point_.algorithm, point_.block_size, input_name_ };
+
+      writer.resume(point_.blocks, point_.blocks * point_.block_size);
+      if (!output.good() || !cut_signature(signature_name_, point_))
+      {
+         error = "can't write output file";
+         return false;
+      }
+      writer.write(results);
+      writer.finish(true);
+
+      if (!output.good())
+      {
+         error = "can't write output file";
+         return false;
+      }
+
+      point_.blocks = size / point_.block_size;
+      covered_size_ = size;
+      return true;
+   }
+};
+
+/**
+ * Follows a growing input, which has a complete signature in the sig format, till it's
+ * moved away or removed, or till cancellation. Returns an exit status.
+ */
+inline int follow_input(const std::string & input_name, const std::string & signature_name)
+{
+   input_follower follower { input_name, signature_name };
+   std::string error = follower.open(), reason;
+
+   // Data which has been appended before the watch is taken by the first round.
+   if (error.empty()) follower.update(error);
+   if (!error.empty())
+   {
+      std::cerr << "can't follow input file: " << error << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   std::cout << "following input file" << std::endl;
+
+   while (follower.wait(reason))
+   {
+      if (!follower.update(error))
+      {
+         std::cerr << "can't follow input file: " << error << std::endl;
+         return EXIT_FAILURE;
+      }
+   }
+
+   if (!reason.empty()) std::cout << reason << std::endl;
+   return EXIT_SUCCESS;
+}
+
+#endif /* APPEND_HPP_ */
@@ -0,0 +1,239 @@
+/*
+ * autoscale.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: simonenkos
+ */
+
+#ifndef AUTOSCALE_HPP_
+#define AUTOSCALE_HPP_
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <boost/any.hpp>
+#include <boost/regex.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/program_options.hpp>
+
+#include "scheduler.hpp"
+#include "stats.hpp"
+
+namespace
+{
+
+// Period of measurements of the pipeline, after each of them the controller may
+// change the number of workers and the read-ahead by a single step.
+constexpr int    AUTOSCALE_PERIOD_MS  = 100;
+// Share of a period the reader waits for room in the queue, above which the run is CPU-bound.
+constexpr double AUTOSCALE_WAIT_SHARE = 0.1;
+// Share of a period the reader is reading, above which the run may be I/O-bound.
+constexpr double AUTOSCALE_READ_SHARE = 0.5;
+// Shares of time workers are idle, below which they are saturated and above which some of them are spare.
+constexpr double AUTOSCALE_BUSY_SHARE = 0.2;
+constexpr double AUTOSCALE_IDLE_SHARE = 0.3;
+
+}
+
+/**
+ * Number or a range of numbers "<min>-<max>", which is adjusted at runtime.
+ * A range of zeros means no limit.
+ */
+struct scaling_range
+{
+   unsigned min;
+   unsigned max;
+
+   bool scaled() const
+   {
+      return min != max;
+   }
+};
+
+/**
+ * Overload function for validation of scaling_range values needed for boost::program_options.
+ */
+inline void validate(boost::any & value, const std::vector<std::string> & string_values, scaling_range * target_type, int)
+{
+   namespace bpo = boost::program_options;
+   static const boost::regex r("^(\\d+)(-(\\d+))?$");
+
+   bpo::validators::check_first_occurrence(value);
+   boost::smatch match;
+
+   if (regex_match(bpo::validators::get_single_string(string_values), match, r))
+   {
+      scaling_range range;
+
+      try
+      {
+         range.min = boost::lexical_cast<unsigned>(match[1]);
+         range.max = match[3].matched ? boost::lexical_cast<unsigned>(match[3]) : range.min;
+      }
+      catch (boost::bad_lexical_cast & e)
+      {
+         throw bpo::validation_error
+         (
+               bpo::validation_error::invalid_option_value
+         );
+      }
+
+      if (range.min != 0 && range.min <= range.max)
+      {
+         value = boost::any(range);
+         return;
+      }
+   }
+   throw bpo::validation_error
+   (
+         bpo::validation_error::invalid_option_value
+   );
+}
+
+/**
+ * Feedback controller of the number of hashing workers and of the read-ahead, i.e. the number
+ * of blocks which are read, but not given to a worker yet. Every period it looks at the time
+ * the reader spent reading and waiting for room in the queue, at the depth of the queue and
+ * at the time workers were idle:
+ *  - the reader waits for workers, which are busy: the run is CPU-bound, a worker is added
+ *    and the read-ahead is doubled, so the queue fills and covers slow reads later on;
+ *  - the reader is mostly reading, the queue is empty and workers are idle: the run is
+ *    I/O-bound, a worker is removed to free a core and the read-ahead is halved.
+ * Both are kept within configured ranges; a fixed number is just a limit.
+ */
+class autoscaler
+{
+   ordered_scheduler & scheduler_;
+   pipeline_stats & stats_;
+   const scaling_range workers_range_;
+   const scaling_range read_ahead_range_;
+   const size_t blocks_per_task_;
+
+   // Current limits, the read-ahead is counted in blocks, 0 is unlimited.
+   unsigned workers_;
+   std::atomic<unsigned> read_ahead_;
+
+   // Time in nanoseconds the reader spent reading and waiting during the current period.
+   std::atomic<uint64_t> read_time_;
+   std::atomic<uint64_t> wait_time_;
+
+   std::mutex mutex_;
+   std::condition_variable stop_requested_;
+   bool stopped_;
+   std::thread monitor_;
+
+   void monitor()
+   {
+      auto last = std::chrono::steady_clock::now();
+      auto last_busy = scheduler_.busy_time();
+      std::unique_lock<std::mutex> lock(mutex_);
+
+      while (!stop_requested_.wait_for(lock, std::chrono::milliseconds(AUTOSCALE_PERIOD_MS), [this]() { return stopped_; }))
+      {
+         auto now  = std::chrono::steady_clock::now();
+         auto busy = scheduler_.busy_time();
+         double period = std::chrono::duration<double, std::nano>(now - last).count();
+         unsigned workers = workers_ ? workers_ : std::max(1u, std::thread::hardware_concurrency());
+
+         double reading = read_time_.exchange(0) / period;
+         double waiting = wait_time_.exchange(0) / period;
+         double idle = 1.0 - (busy - last_busy).count() / (period * workers);
+
+         last = now;
+         last_busy = busy;
+
+         if (waiting > AUTOSCALE_WAIT_SHARE)
+         {
+            bool changed = false;
+
+            if (idle < AUTOSCALE_BUSY_SHARE && workers_ < workers_range_.max)
+            {
+               workers_++;
+               changed = true;
+            }
+            if (read_ahead_ < read_ahead_range_.max)
+            {
+               read_ahead_ = std::min(read_ahead_range_.max, read_ahead_ * 2);
+               changed = true;
+            }
+            if (changed) stats_.scale_ups++;
+         }
+         else if (reading > AUTOSCALE_READ_SHARE && idle > AUTOSCALE_IDLE_SHARE && scheduler_.queued() == 0)
+         {
+            bool changed = false;
+
+            if (workers_ > workers_range_.min)
+            {
+               workers_--;
+               changed = true;
+            }
+            if (read_ahead_ > read_ahead_range_.min)
+            {
+               read_ahead_ = std::max(read_ahead_range_.min, read_ahead_ / 2);
+               changed = true;
+            }
+            if (changed) stats_.scale_downs++;
+         }
+
+         if (workers_ != 0) scheduler_.set_worker_limit(workers_);
+         stats_.workers    = workers_;
+         stats_.read_ahead = read_ahead_;
+      }
+   }
+
+public:
+   // Workers start at the maximum and the read-ahead at the minimum, the controller is
+   // started only if any of them is a range.
+   autoscaler(ordered_scheduler & scheduler, pipeline_stats & stats, scaling_range workers, scaling_range read_ahead,
+              size_t blocks_per_task)
+      : scheduler_(scheduler), stats_(stats), workers_range_(workers), read_ahead_range_(read_ahead),
+        blocks_per_task_(blocks_per_task), workers_(workers.max), read_ahead_(read_ahead.min),
+        read_time_(0), wait_time_(0), stopped_(false)
+   {
+      if (workers_ != 0) scheduler_.set_worker_limit(workers_);
+
+      stats_.workers    = workers_;
+      stats_.read_ahead = read_ahead_;
+
+      if (workers.scaled() || read_ahead.scaled())
+         monitor_ = std::thread(&autoscaler::monitor, this);
+   }
+
+   ~autoscaler()
+   {
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+         stopped_ = true;
+      }
+      stop_requested_.notify_all();
+      if (monitor_.joinable()) monitor_.join();
+   }
+
+   // Called by the reader after a block has been read during a given time.
+   void block_read(std::chrono::steady_clock::duration read_time)
+   {
+      read_time_ += std::chrono::duration_cast<std::chrono::nanoseconds>(read_time).count();
+   }
+
+   // Called by the reader before a block is read, waits while the queue is full.
+   void wait_for_room()
+   {
+      unsigned read_ahead = read_ahead_.load();
+
+      if (read_ahead == 0) return;
+
+      auto start = std::chrono::steady_clock::now();
+      size_t tasks = (read_ahead + blocks_per_task_ - 1) / blocks_per_task_;
+
+      scheduler_.wait_queued_below(std::max<size_t>(1, tasks));
+      wait_time_ += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+   }
+};
+
+#endif /* AUTOSCALE_HPP_ */
@@ -0,0 +1,219 @@
+/*
+ * benchmark.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: simonenkos
+ */
+
+#ifndef BENCHMARK_HPP_
+#define BENCHMARK_HPP_
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+
+#include <boost/crc.hpp>
+
+#include "blake3.hpp"
+#include "crc32.hpp"
+#include "sha256.hpp"
+
+namespace
+{
+
+// Amount of data hashed by each kernel in a benchmark.
+constexpr uint64_t BENCHMARK_DATA_SIZE = 256 * 1024 * 1024;
+
+}
+
+/**
+ * Runs a kernel over blocks of a buffer, prints its throughput and returns
+ * a combination of all digests to check that kernels agree.
+ */
+inline uint32_t benchmark_kernel(const char * name, const std::vector<uint8_t> & buffer, uint64_t block_size,
+                                 const std::function<uint32_t(const uint8_t *, size_t)> & kernel)
+{
+   uint64_t rounds = std::max<uint64_t>(1, BENCHMARK_DATA_SIZE / buffer.size());
+   uint32_t digest = 0;
+
+   auto start = std::chrono::steady_clock::now();
+
+   for (uint64_t round = 0; round < rounds; round++)
+   {
+      for (size_t offset = 0; offset < buffer.size(); offset += block_size)
+         digest ^= kernel(buffer.data() + offset, std::min<uint64_t>(block_size, buffer.size() - offset));
+   }
+
+   double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+   std::printf("%-24s %10.1f MB/s\n", name, rounds * buffer.size() / seconds / 1e6);
+   return digest;
+}
+
+/**
+ * Measures throughput of hashing kernels on random data split into blocks of a given size.
+ * Returns false if kernels don't produce the same results.
+ */
+inline bool run_benchmark(uint64_t block_size)
+{
+   std::vector<uint8_t> buffer(std::max<uint64_t>(block_size, 64 * 1024 * 1024) / block_size * block_size);
+   std::mt19937 random;
+
+   for (auto & byte : buffer) byte = random();
+
+   std::printf("block size = %llu\n", static_cast<unsigned long long>(block_size));
+
+   uint32_t reference = benchmark_kernel("boost::crc_32_type", buffer, block_size, [](const uint8_t * data, size_t size)
+   {
+      boost::crc_32_type crc_hash;
+      crc_hash.process_bytes(data, size);
+      return crc_hash.checksum();
+   });
+
+   bool agree = true;
+
+   agree &= reference == benchmark_kernel("crc32 generic", buffer, block_size, [](const uint8_t * data, size_t size)
+   {
+      return ~crc32_update(~0u, data, size);
+   });
+
+   crc32_fixed_kernel kernel = crc32_kernel_for(block_size);
+
+   if (kernel != nullptr)
+   {
+      agree &= reference == benchmark_kernel("crc32 specialised", buffer, block_size, [kernel, block_size](const uint8_t * data, size_t size)
+      {
+         return (size == block_size) ? ~kernel(~0u, data) : ~crc32_update(~0u, data, size);
+      });
+   }
+   else std::printf("%-24s %15s\n", "crc32 specialised", "n/a");
+
+   agree &= reference == benchmark_kernel("crc32 interleaved batch", buffer, block_size * CRC32_BATCH_SIZE,
+                                          [block_size](const uint8_t * data, size_t size)
+   {
+      // Hash a batch of consecutive blocks at once, combining their digests
+      // the same way as the reference does.
+      const uint8_t * blocks[CRC32_BATCH_SIZE];
+      size_t sizes[CRC32_BATCH_SIZE];
+      uint32_t crcs[CRC32_BATCH_SIZE];
+      size_t count = 0;
+
+      for (size_t offset = 0; offset < size; offset += block_size, count++)
+      {
+         blocks[count] = data + offset;
+         sizes[count]  = std::min<size_t>(block_size, size - offset);
+      }
+      crc32_blocks(blocks, sizes, count, crcs, block_size, nullptr);
+
+      uint32_t digest = 0;
+      for (size_t i = 0; i < count; i++) digest ^= crcs[i];
+      return digest;
+   });
+
+#if defined(__x86_64__)
+   if (crc32_avx512_supported())
+   {
+      agree &= reference == benchmark_kernel("crc32 avx512 vpclmulqdq", buffer, block_size, [](const uint8_t * data, size_t size)
+      {
+         return ~crc32_avx512(~0u, data, size);
+      });
+   }
+   else std::printf("%-24s %15s\n", "crc32 avx512 vpclmulqdq", "n/a");
+#endif
+
+   // Digests of other algorithms are compared by their first 4 bytes.
+   auto digest_prefix = [](const uint8_t * digest)
+   {
+      uint32_t prefix;
+      std::memcpy(&prefix, digest, sizeof(prefix));
+      return prefix;
+   };
+
+   uint32_t sha256_reference = benchmark_kernel("sha256 generic", buffer, block_size, [&digest_prefix](const uint8_t * data, size_t size)
+   {
+      uint8_t digest[SHA256_DIGEST_SIZE];
+      sha256(data, size, digest, sha256_compress_scalar);
+      return digest_prefix(digest);
+   });
+
+#if defined(__x86_64__)
+   if (sha256_shani_supported())
+   {
+      agree &= sha256_reference == benchmark_kernel("sha256 sha-ni", buffer, block_size, [&digest_prefix](const uint8_t * data, size_t size)
+      {
+         uint8_t digest[SHA256_DIGEST_SIZE];
+         sha256(data, size, digest, sha256_compress_shani);
+         return digest_prefix(digest);
+      });
+   }
+   else std::printf("%-24s %15s\n", "sha256 sha-ni", "n/a");
+
+   if (sha256_avx2_supported())
+   {
+      agree &= sha256_reference == benchmark_kernel("sha256 avx2 multi-buffer", buffer, block_size * SHA256_LANES,
+                                                    [block_size, &digest_prefix](const uint8_t * data, size_t size)
+      {
+         // Hash a group of consecutive blocks at once, 8 messages per AVX2 register.
+         const uint8_t * blocks[SHA256_LANES] = { };
+         size_t sizes[SHA256_LANES] = { };
+         uint8_t digests[SHA256_LANES * SHA256_DIGEST_SIZE];
+         size_t count = 0;
+
+         for (size_t offset = 0; offset < size; offset += block_size, count++)
+         {
+            blocks[count] = data + offset;
+            sizes[count]  = std::min<size_t>(block_size, size - offset);
+         }
+         sha256_messages_avx2x8(blocks, sizes, count, digests);
+
+         uint32_t prefix = 0;
+         for (size_t i = 0; i < count; i++) prefix ^= digest_prefix(digests + i * SHA256_DIGEST_SIZE);
+         return prefix;
+      });
+   }
+   else std::printf("%-24s %15s\n", "sha256 avx2 multi-buffer", "n/a");
+#endif
+
+   uint32_t blake3_reference = benchmark_kernel("blake3 portable", buffer, block_size, [&digest_prefix](const uint8_t * data, size_t size)
+   {
+      uint8_t digest[BLAKE3_DIGEST_SIZE];
+      blake3(data, size, digest, false);
+      return digest_prefix(digest);
+   });
+
+   if (blake3_simd_supported())
+   {
+      agree &= blake3_reference == benchmark_kernel("blake3 avx2", buffer, block_size * BLAKE3_LANES,
+                                                    [block_size, &digest_prefix](const uint8_t * data, size_t size)
+      {
+         // Hash a group of consecutive blocks, which share AVX2 registers when they
+         // are too small to fill them by themselves.
+         const uint8_t * blocks[BLAKE3_LANES] = { };
+         size_t sizes[BLAKE3_LANES] = { };
+         uint8_t digests[BLAKE3_LANES * BLAKE3_DIGEST_SIZE];
+         size_t count = 0;
+
+         for (size_t offset = 0; offset < size; offset += block_size, count++)
+         {
+            blocks[count] = data + offset;
+            sizes[count]  = std::min<size_t>(block_size, size - offset);
+         }
+         blake3_messages(blocks, sizes, count, digests, true);
+
+         uint32_t prefix = 0;
+         for (size_t i = 0; i < count; i++) prefix ^= digest_prefix(digests + i * BLAKE3_DIGEST_SIZE);
+         return prefix;
+      });
+   }
+   else std::printf("%-24s %15s\n", "blake3 avx2", "n/a");
+
+   if (!agree) std::printf("kernels produce different results\n");
+
+   return agree;
+}
+
+#endif /* BENCHMARK_HPP_ */
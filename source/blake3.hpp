@@ -0,0 +1,471 @@
+/*
+ * blake3.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: simonenkos
+ */
+
+#ifndef BLAKE3_HPP_
+#define BLAKE3_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace
+{
+
+constexpr size_t BLAKE3_BLOCK_SIZE  = 64;
+constexpr size_t BLAKE3_CHUNK_SIZE  = 1024;
+constexpr size_t BLAKE3_DIGEST_SIZE = 32;
+
+// Number of chunks hashed at once by the SIMD kernel.
+constexpr size_t BLAKE3_LANES = 8;
+
+// Maximum depth of the tree, enough for 2^64 bytes of input.
+constexpr size_t BLAKE3_MAX_DEPTH = 54;
+
+constexpr uint32_t BLAKE3_CHUNK_START = 1 << 0;
+constexpr uint32_t BLAKE3_CHUNK_END   = 1 << 1;
+constexpr uint32_t BLAKE3_PARENT      = 1 << 2;
+constexpr uint32_t BLAKE3_ROOT        = 1 << 3;
+
+const uint32_t BLAKE3_IV[8] =
+{
+   0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+// Order of message words in each of 7 rounds, the permutation applied round after round.
+const uint8_t BLAKE3_SCHEDULE[7][16] =
+{
+   {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+   {  2,  6,  3, 10,  7,  0,  4, 13,  1, 11, 12,  5,  9, 14, 15,  8 },
+   {  3,  4, 10, 12, 13,  2,  7, 14,  6,  5,  9,  0, 11, 15,  8,  1 },
+   { 10,  7, 12,  9, 14,  3, 13, 15,  4,  0, 11,  2,  5,  8,  1,  6 },
+   { 12, 13,  9, 11, 15, 10, 14,  8,  7,  2,  5,  3,  0,  1,  6,  4 },
+   {  9, 14, 11,  5,  8, 12, 15,  1, 13,  3,  0, 10,  2,  6,  4,  7 },
+   { 11, 15,  5,  0,  1,  9,  8,  6, 14, 10,  2, 12,  3,  4,  7, 13 }
+};
+
+}
+
+inline uint32_t blake3_rotr(uint32_t x, int n)
+{
+   return (x >> n) | (x << (32 - n));
+}
+
+inline void blake3_g(uint32_t * v, int a, int b, int c, int d, uint32_t x, uint32_t y)
+{
+   v[a] = v[a] + v[b] + x; v[d] = blake3_rotr(v[d] ^ v[a], 16);
+   v[c] = v[c] + v[d];     v[b] = blake3_rotr(v[b] ^ v[c], 12);
+   v[a] = v[a] + v[b] + y; v[d] = blake3_rotr(v[d] ^ v[a], 8);
+   v[c] = v[c] + v[d];     v[b] = blake3_rotr(v[b] ^ v[c], 7);
+}
+
+/**
+ * Compresses a 64 byte block into a chaining value, returns the first 8 words
+ * of the resulting state, which is all this tool needs of output.
+ */
+inline void blake3_compress(uint32_t * cv, const uint8_t * block, uint64_t counter, uint32_t block_size, uint32_t flags)
+{
+   uint32_t m[16], v[16];
+
+   for (int i = 0; i < 16; i++)
+      m[i] = uint32_t(block[4 * i]) | (uint32_t(block[4 * i + 1]) << 8) | (uint32_t(block[4 * i + 2]) << 16) | (uint32_t(block[4 * i + 3]) << 24);
+
+   std::memcpy(v, cv, 8 * sizeof(uint32_t));
+   std::memcpy(v + 8, BLAKE3_IV, 4 * sizeof(uint32_t));
+   v[12] = static_cast<uint32_t>(counter);
+   v[13] = static_cast<uint32_t>(counter >> 32);
+   v[14] = block_size;
+   v[15] = flags;
+
+   for (int round = 0; round < 7; round++)
+   {
+      const uint8_t * s = BLAKE3_SCHEDULE[round];
+
+      blake3_g(v, 0, 4,  8, 12, m[s[0]],  m[s[1]]);
+      blake3_g(v, 1, 5,  9, 13, m[s[2]],  m[s[3]]);
+      blake3_g(v, 2, 6, 10, 14, m[s[4]],  m[s[5]]);
+      blake3_g(v, 3, 7, 11, 15, m[s[6]],  m[s[7]]);
+      blake3_g(v, 0, 5, 10, 15, m[s[8]],  m[s[9]]);
+      blake3_g(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+      blake3_g(v, 2, 7,  8, 13, m[s[12]], m[s[13]]);
+      blake3_g(v, 3, 4,  9, 14, m[s[14]], m[s[15]]);
+   }
+
+   for (int i = 0; i < 8; i++)
+      cv[i] = v[i] ^ v[i + 8];
+}
+
+/**
+ * Everything needed to compress the last block of a node, which is postponed
+ * until it's known whether the node is the root.
+ */
+struct blake3_output
+{
+   uint32_t cv[8];
+   uint8_t  block[BLAKE3_BLOCK_SIZE];
+   uint64_t counter;
+   uint32_t block_size;
+   uint32_t flags;
+
+   void chaining_value(uint32_t * result) const
+   {
+      std::memcpy(result, cv, sizeof(cv));
+      blake3_compress(result, block, counter, block_size, flags);
+   }
+
+   void root_digest(uint8_t * digest) const
+   {
+      uint32_t result[8];
+
+      std::memcpy(result, cv, sizeof(cv));
+      blake3_compress(result, block, 0, block_size, flags | BLAKE3_ROOT);
+
+      for (int i = 0; i < 8; i++)
+      {
+         digest[4 * i]     = result[i];
+         digest[4 * i + 1] = result[i] >> 8;
+         digest[4 * i + 2] = result[i] >> 16;
+         digest[4 * i + 3] = result[i] >> 24;
+      }
+   }
+};
+
+/**
+ * Compresses all blocks of a chunk but the last one and returns the output of it.
+ */
+inline blake3_output blake3_chunk(const uint8_t * data, size_t size, uint64_t counter)
+{
+   blake3_output output;
+   uint32_t flags = BLAKE3_CHUNK_START;
+
+   std::memcpy(output.cv, BLAKE3_IV, sizeof(output.cv));
+
+   for (; size > BLAKE3_BLOCK_SIZE; data += BLAKE3_BLOCK_SIZE, size -= BLAKE3_BLOCK_SIZE)
+   {
+      blake3_compress(output.cv, data, counter, BLAKE3_BLOCK_SIZE, flags);
+      flags = 0;
+   }
+
+   std::memset(output.block, 0, sizeof(output.block));
+   std::memcpy(output.block, data, size);
+   output.counter    = counter;
+   output.block_size = static_cast<uint32_t>(size);
+   output.flags      = flags | BLAKE3_CHUNK_END;
+
+   return output;
+}
+
+inline blake3_output blake3_parent(const uint32_t * left, const uint32_t * right)
+{
+   blake3_output output;
+
+   std::memcpy(output.cv, BLAKE3_IV, sizeof(output.cv));
+   for (int i = 0; i < 8; i++)
+   {
+      for (int j = 0; j < 4; j++)
+      {
+         output.block[4 * i + j]      = left[i] >> (8 * j);
+         output.block[32 + 4 * i + j] = right[i] >> (8 * j);
+      }
+   }
+   output.counter    = 0;
+   output.block_size = BLAKE3_BLOCK_SIZE;
+   output.flags      = BLAKE3_PARENT;
+
+   return output;
+}
+
+/**
+ * Portable kernel: chaining values of count full chunks starting with a given counter.
+ */
+inline void blake3_chunks_portable(const uint8_t * data, size_t count, uint64_t counter, uint32_t * cvs)
+{
+   for (size_t i = 0; i < count; i++)
+      blake3_chunk(data + i * BLAKE3_CHUNK_SIZE, BLAKE3_CHUNK_SIZE, counter + i).chaining_value(cvs + 8 * i);
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("avx2")))
+inline __m256i blake3_rotr8x(__m256i x, int n)
+{
+   return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+}
+
+__attribute__((target("avx2")))
+inline void blake3_g8x(__m256i * v, int a, int b, int c, int d, __m256i x, __m256i y)
+{
+   const __m256i rotate16 = _mm256_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2,
+                                            13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2);
+   const __m256i rotate8  = _mm256_set_epi8(12, 15, 14, 13, 8, 11, 10, 9, 4, 7, 6, 5, 0, 3, 2, 1,
+                                            12, 15, 14, 13, 8, 11, 10, 9, 4, 7, 6, 5, 0, 3, 2, 1);
+
+   v[a] = _mm256_add_epi32(_mm256_add_epi32(v[a], v[b]), x);
+   v[d] = _mm256_shuffle_epi8(_mm256_xor_si256(v[d], v[a]), rotate16);
+   v[c] = _mm256_add_epi32(v[c], v[d]);
+   v[b] = blake3_rotr8x(_mm256_xor_si256(v[b], v[c]), 12);
+   v[a] = _mm256_add_epi32(_mm256_add_epi32(v[a], v[b]), y);
+   v[d] = _mm256_shuffle_epi8(_mm256_xor_si256(v[d], v[a]), rotate8);
+   v[c] = _mm256_add_epi32(v[c], v[d]);
+   v[b] = blake3_rotr8x(_mm256_xor_si256(v[b], v[c]), 7);
+}
+
+__attribute__((target("avx2")))
+inline void blake3_transpose8x8(__m256i * rows)
+{
+   __m256i t[8], u[8];
+
+   for (int i = 0; i < 8; i += 2)
+   {
+      t[i]     = _mm256_unpacklo_epi32(rows[i], rows[i + 1]);
+      t[i + 1] = _mm256_unpackhi_epi32(rows[i], rows[i + 1]);
+   }
+   for (int i = 0; i < 8; i += 4)
+   {
+      u[i]     = _mm256_unpacklo_epi64(t[i],     t[i + 2]);
+      u[i + 1] = _mm256_unpackhi_epi64(t[i],     t[i + 2]);
+      u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+      u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+   }
+   for (int i = 0; i < 4; i++)
+   {
+      rows[i]     = _mm256_permute2x128_si256(u[i], u[i + 4], 0x20);
+      rows[i + 4] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x31);
+   }
+}
+
+/**
+ * SIMD kernel: chaining values of 8 chunks of a given number of full blocks, which
+ * are compressed in parallel, a chunk per 32 bit lane of AVX2 vectors. Chunks may
+ * belong to different messages, so each lane has its own data and counter, and the
+ * flags of the last block may mark the chunks as roots.
+ */
+__attribute__((target("avx2")))
+inline void blake3_chunks_avx2x8(const uint8_t * const * chunks, const uint64_t * counters, size_t blocks,
+                                 uint32_t last_flags, uint32_t * cvs)
+{
+   __m256i cv[8];
+
+   for (int i = 0; i < 8; i++)
+      cv[i] = _mm256_set1_epi32(BLAKE3_IV[i]);
+
+   const __m256i counter_low  = _mm256_setr_epi32(counters[0],       counters[1],       counters[2],       counters[3],
+                                                  counters[4],       counters[5],       counters[6],       counters[7]);
+   const __m256i counter_high = _mm256_setr_epi32(counters[0] >> 32, counters[1] >> 32, counters[2] >> 32, counters[3] >> 32,
+                                                  counters[4] >> 32, counters[5] >> 32, counters[6] >> 32, counters[7] >> 32);
+
+   for (size_t block = 0; block < blocks; block++)
+   {
+      __m256i m[16], v[16];
+
+      for (int half = 0; half < 2; half++)
+      {
+         for (size_t lane = 0; lane < BLAKE3_LANES; lane++)
+         {
+            const uint8_t * words = chunks[lane] + block * BLAKE3_BLOCK_SIZE + 32 * half;
+            m[8 * half + lane] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(words));
+         }
+         blake3_transpose8x8(m + 8 * half);
+      }
+
+      uint32_t flags = (block == 0 ? BLAKE3_CHUNK_START : 0) |
+                       (block == blocks - 1 ? BLAKE3_CHUNK_END | last_flags : 0);
+
+      for (int i = 0; i < 8; i++) v[i] = cv[i];
+      for (int i = 0; i < 4; i++) v[8 + i] = _mm256_set1_epi32(BLAKE3_IV[i]);
+      v[12] = counter_low;
+      v[13] = counter_high;
+      v[14] = _mm256_set1_epi32(BLAKE3_BLOCK_SIZE);
+      v[15] = _mm256_set1_epi32(flags);
+
+      for (int round = 0; round < 7; round++)
+      {
+         const uint8_t * s = BLAKE3_SCHEDULE[round];
+
+         blake3_g8x(v, 0, 4,  8, 12, m[s[0]],  m[s[1]]);
+         blake3_g8x(v, 1, 5,  9, 13, m[s[2]],  m[s[3]]);
+         blake3_g8x(v, 2, 6, 10, 14, m[s[4]],  m[s[5]]);
+         blake3_g8x(v, 3, 7, 11, 15, m[s[6]],  m[s[7]]);
+         blake3_g8x(v, 0, 5, 10, 15, m[s[8]],  m[s[9]]);
+         blake3_g8x(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+         blake3_g8x(v, 2, 7,  8, 13, m[s[12]], m[s[13]]);
+         blake3_g8x(v, 3, 4,  9, 14, m[s[14]], m[s[15]]);
+      }
+
+      for (int i = 0; i < 8; i++)
+         cv[i] = _mm256_xor_si256(v[i], v[i + 8]);
+   }
+
+   blake3_transpose8x8(cv);
+   for (int i = 0; i < 8; i++)
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(cvs + 8 * i), cv[i]);
+}
+
+#endif
+
+inline bool blake3_simd_supported()
+{
+#if defined(__x86_64__)
+   static const bool supported = __builtin_cpu_supports("avx2");
+   return supported;
+#else
+   return false;
+#endif
+}
+
+/**
+ * Calculates BLAKE3 digest of a message. All chunks but the last one are full,
+ * so their chaining values are computed independently, 8 chunks at once with
+ * AVX2 if it's supported and not disabled, and then merged into the tree in order.
+ * The last chunk is kept till the end, because it may be the root.
+ */
+inline void blake3(const uint8_t * data, size_t size, uint8_t * digest, bool simd = blake3_simd_supported())
+{
+   size_t full_chunks = (size == 0) ? 0 : (size - 1) / BLAKE3_CHUNK_SIZE;
+
+   uint32_t stack[BLAKE3_MAX_DEPTH][8];
+   size_t stack_size = 0;
+   uint64_t chunk = 0;
+
+   while (chunk < full_chunks)
+   {
+      uint32_t cvs[BLAKE3_LANES][8];
+      size_t count = std::min<uint64_t>(BLAKE3_LANES, full_chunks - chunk);
+
+#if defined(__x86_64__)
+      if (count == BLAKE3_LANES && simd)
+      {
+         const uint8_t * chunks[BLAKE3_LANES];
+         uint64_t counters[BLAKE3_LANES];
+
+         for (size_t i = 0; i < BLAKE3_LANES; i++)
+         {
+            chunks[i]   = data + (chunk + i) * BLAKE3_CHUNK_SIZE;
+            counters[i] = chunk + i;
+         }
+         blake3_chunks_avx2x8(chunks, counters, BLAKE3_CHUNK_SIZE / BLAKE3_BLOCK_SIZE, 0, cvs[0]);
+      }
+      else
+#endif
+      blake3_chunks_portable(data + chunk * BLAKE3_CHUNK_SIZE, count, chunk, cvs[0]);
+
+      for (size_t i = 0; i < count; i++)
+      {
+         // Push the chaining value, merging completed subtrees: there are as many
+         // of them as trailing zero bits in the number of chunks so far.
+         uint32_t * cv = cvs[i];
+
+         for (uint64_t total = ++chunk; (total & 1) == 0; total >>= 1)
+            blake3_parent(stack[--stack_size], cv).chaining_value(cv);
+
+         std::memcpy(stack[stack_size++], cv, sizeof(stack[0]));
+      }
+   }
+
+   blake3_output output = blake3_chunk(data + chunk * BLAKE3_CHUNK_SIZE, size - chunk * BLAKE3_CHUNK_SIZE, chunk);
+
+   while (stack_size != 0)
+   {
+      uint32_t cv[8];
+
+      output.chaining_value(cv);
+      output = blake3_parent(stack[--stack_size], cv);
+   }
+
+   output.root_digest(digest);
+}
+
+/**
+ * Calculates BLAKE3 digests of count messages. A single message of 8 KiB and more
+ * keeps all lanes busy by itself, but smaller ones don't, so 8 messages of the same
+ * size, made of whole blocks and whole chunks, are hashed together with AVX2: the
+ * chunks of the same index in all messages at once, and then each tree in turn.
+ */
+inline void blake3_messages(const uint8_t * const * data, const size_t * sizes, size_t count, uint8_t * digests,
+                            bool simd = blake3_simd_supported())
+{
+#if defined(__x86_64__)
+   for (; simd && count >= BLAKE3_LANES; data += BLAKE3_LANES, sizes += BLAKE3_LANES, count -= BLAKE3_LANES)
+   {
+      size_t size = sizes[0];
+
+      if (size == 0 || size >= BLAKE3_LANES * BLAKE3_CHUNK_SIZE || size % BLAKE3_BLOCK_SIZE != 0 ||
+          (size > BLAKE3_CHUNK_SIZE && size % BLAKE3_CHUNK_SIZE != 0) ||
+          std::any_of(sizes + 1, sizes + BLAKE3_LANES, [size](size_t other) { return other != size; }))
+         break;
+
+      size_t chunk_count = (size + BLAKE3_CHUNK_SIZE - 1) / BLAKE3_CHUNK_SIZE;
+      size_t blocks = std::min(size, BLAKE3_CHUNK_SIZE) / BLAKE3_BLOCK_SIZE;
+      uint32_t cvs[BLAKE3_LANES][BLAKE3_LANES][8];
+
+      for (size_t chunk = 0; chunk < chunk_count; chunk++)
+      {
+         const uint8_t * chunks[BLAKE3_LANES];
+         uint64_t counters[BLAKE3_LANES];
+
+         for (size_t lane = 0; lane < BLAKE3_LANES; lane++)
+         {
+            chunks[lane]   = data[lane] + chunk * BLAKE3_CHUNK_SIZE;
+            counters[lane] = chunk;
+         }
+         blake3_chunks_avx2x8(chunks, counters, blocks, chunk_count == 1 ? BLAKE3_ROOT : 0, cvs[chunk][0]);
+      }
+
+      for (size_t lane = 0; lane < BLAKE3_LANES; lane++)
+      {
+         uint8_t * digest = digests + lane * BLAKE3_DIGEST_SIZE;
+
+         if (chunk_count == 1)
+         {
+            for (int i = 0; i < 8; i++)
+            {
+               digest[4 * i]     = cvs[0][lane][i];
+               digest[4 * i + 1] = cvs[0][lane][i] >> 8;
+               digest[4 * i + 2] = cvs[0][lane][i] >> 16;
+               digest[4 * i + 3] = cvs[0][lane][i] >> 24;
+            }
+            continue;
+         }
+
+         // Same tree as in blake3(), except that the last chunk is a full one too.
+         uint32_t stack[BLAKE3_MAX_DEPTH][8];
+         size_t stack_size = 0;
+
+         for (size_t chunk = 0; chunk + 1 < chunk_count; chunk++)
+         {
+            uint32_t * cv = cvs[chunk][lane];
+
+            for (uint64_t total = chunk + 1; (total & 1) == 0; total >>= 1)
+               blake3_parent(stack[--stack_size], cv).chaining_value(cv);
+
+            std::memcpy(stack[stack_size++], cv, sizeof(stack[0]));
+         }
+
+         blake3_output output = blake3_parent(stack[--stack_size], cvs[chunk_count - 1][lane]);
+
+         while (stack_size != 0)
+         {
+            uint32_t cv[8];
+
+            output.chaining_value(cv);
+            output = blake3_parent(stack[--stack_size], cv);
+         }
+         output.root_digest(digest);
+      }
+      digests += BLAKE3_LANES * BLAKE3_DIGEST_SIZE;
+   }
+#endif
+
+   for (size_t i = 0; i < count; i++)
+      blake3(data[i], sizes[i], digests + i * BLAKE3_DIGEST_SIZE, simd);
+}
+
+#endif /* BLAKE3_HPP_ */
@@ -0,0 +1,340 @@
+/*
+ * block_device.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: simonenkos
+ */
+
+#ifndef BLOCK_DEVICE_HPP_
+#define BLOCK_DEVICE_HPP_
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <linux/fs.h>
+
+#include "block_order.hpp"
+
+namespace
+{
+
+// Number of reads kept in flight on a device, which is also bounded by its request queue.
+constexpr unsigned DEVICE_QUEUE_DEPTH_SOLID      = 32;
+constexpr unsigned DEVICE_QUEUE_DEPTH_ROTATIONAL = 4;
+// Size of a single read if a device doesn't report an optimal one.
+constexpr uint64_t DEVICE_DEFAULT_REQUEST = 128 * 1024;
+
+}
+
+/**
+ * Geometry and capabilities of a block device, as reported by the kernel.
+ */
+struct device_geometry
+{
+   uint64_t size;
+   unsigned logical_sector;
+   unsigned physical_sector;
+   // Optimal size of an I/O request, 0 if it's not reported.
+   unsigned optimal_io;
+   // Size of the request queue of the device.
+   unsigned queue_size;
+   bool rotational;
+   // Device supports discard, discarded ranges of thin volumes and SSDs usually read as zeros.
+   bool discard;
+};
+
+/**
+ * Checks whether a name is of a block device.
+ */
+inline bool is_block_device(const std::string & name)
+{
+   struct stat st;
+
+   return stat(name.c_str(), &st) == 0 && S_ISBLK(st.st_mode);
+}
+
+/**
+ * Reads a number of a sysfs attribute, returns 0 if it can't be read.
+ */
+inline uint64_t read_sysfs_number(const std::string & path)
+{
+   std::ifstream file { path };
+   uint64_t value = 0;
+
+   file >> value;
+   return file ? value : 0;
+}
+
+/**
+ * Reads geometry of an open block device with ioctls, the rest of it from sysfs attributes
+ * of its request queue. Partitions have no queue of their own, it's one of the whole device.
+ */
+inline bool read_device_geometry(int fd, device_geometry & geometry)
+{
+   struct stat st;
+   int logical = 0, physical = 0;
+   unsigned optimal = 0;
+
+   if (fstat(fd, &st) != 0 || !S_ISBLK(st.st_mode) || ioctl(fd, BLKGETSIZE64, &geometry.size) != 0)
+      return false;
+
+   ioctl(fd, BLKSSZGET, &logical);
+   ioctl(fd, BLKPBSZGET, &physical);
+   ioctl(fd, BLKIOOPT, &optimal);
+
+   std::string device = "/sys/dev/block/" + std::to_string(major(st.st_rdev)) + ":" + std::to_string(minor(st.st_rdev));
+   std::string queue = device + "/queue/";
+
+   if (access(queue.c_str(), F_OK) != 0) queue = device + "/../queue/";
+
+   geometry.logical_sector  = logical  > 0 ? logical  : 512;
+   geometry.physical_sector = physical > 0 ? physical : geometry.logical_sector;
+   geometry.optimal_io      = optimal;
+   geometry.queue_size      = read_sysfs_number(queue + "nr_requests");
+   geometry.rotational      = read_sysfs_number(queue + "rotational") != 0;
+   geometry.discard         = read_sysfs_number(queue + "discard_max_bytes") != 0;
+   return true;
+}
+
+/**
+ * Checks whether a block consists of zeros only.
+ */
+inline bool is_zero_block(const char * data, size_t size)
+{
+   return size != 0 && data[0] == 0 && std::memcmp(data, data + 1, size - 1) == 0;
+}
+
+/**
+ * Sequential reading of a block device. Its size comes from the device, not from the file
+ * system, and it's read with direct I/O if the block size is a multiple of its sectors,
+ * so signing a volume doesn't push everything else out of the page cache. Each block is
+ * split to requests of the optimal I/O size, which are read in parallel by a few threads,
+ * keeping enough of them in flight for the device to reach its bandwidth: more for solid
+ * state devices, less for rotational ones, never more than its request queue holds.
+ * Requests of next blocks are submitted while a block is being completed, so the depth
+ * is reached with blocks of any size; a completed block is given in a buffer of its own.
+ */
+class device_order : public block_order
+{
+   // Block which is read, with requests which haven't been completed yet.
+   struct slot
+   {
+      uint64_t block;
+      block_buffer buffer;
+      size_t size;
+      size_t pending;
+      int error;
+   };
+
+   struct request
+   {
+      slot * owner;
+      char * data;
+      size_t size;
+      uint64_t offset;
+   };
+
+   device_geometry geometry_;
+   int direct_fd_;
+   uint64_t request_size_;
+   unsigned queue_depth_;
+   // Number of blocks which are read at once, so their requests fill the queue.
+   size_t blocks_in_flight_;
+   uint64_t next_block_;
+
+   std::mutex mutex_;
+   std::condition_variable request_added_;
+   std::condition_variable request_done_;
+   std::deque<request> requests_;
+   // Blocks in order of submission, references to them stay valid while they are in the deque.
+   std::deque<slot> slots_;
+   std::vector<block_buffer> spare_buffers_;
+   bool stopped_;
+   std::vector<std::thread> readers_;
+
+   bool prepare(const std::string & name) override
+   {
+      if (!read_device_geometry(fd_, geometry_)) return false;
+
+      size_ = geometry_.size;
+      block_count_ = std::max<uint64_t>(1, (size_ + block_size_ - 1) / block_size_);
+
+      if (block_size_ % geometry_.logical_sector == 0)
+         direct_fd_ = ::open(name.c_str(), O_RDONLY | O_DIRECT | O_CLOEXEC);
+
+      // Requests are whole physical sectors and aren't larger than a block.
+      uint64_t request = geometry_.optimal_io ? geometry_.optimal_io : DEVICE_DEFAULT_REQUEST;
+
+      request_size_ = std::min(block_size_, std::max<uint64_t>(geometry_.physical_sector,
+                                                               request / geometry_.physical_sector * geometry_.physical_sector));
+      queue_depth_ = geometry_.rotational ? DEVICE_QUEUE_DEPTH_ROTATIONAL : DEVICE_QUEUE_DEPTH_SOLID;
+      if (geometry_.queue_size != 0) queue_depth_ = std::min(queue_depth_, geometry_.queue_size);
+      queue_depth_ = std::max(1u, queue_depth_);
+
+      // One more block is in flight, so the queue stays full while the first one is given away.
+      uint64_t requests_per_block = (block_size_ + request_size_ - 1) / request_size_;
+
+      blocks_in_flight_ = (queue_depth_ + requests_per_block - 1) / requests_per_block + 1;
+
+      for (unsigned i = 0; i < queue_depth_; i++)
+         readers_.emplace_back(&device_order::reader, this);
+      return true;
+   }
+
+   void reader()
+   {
+      std::unique_lock<std::mutex> lock(mutex_);
+
+      while (true)
+      {
+         request_added_.wait(lock, [this]() { return stopped_ || !requests_.empty(); });
+         if (stopped_) return;
+
+         request job = requests_.front();
+         requests_.pop_front();
+         lock.unlock();
+
+         int error = read_request(job);
+
+         lock.lock();
+         if (error != 0 && job.owner->error == 0) job.owner->error = error;
+         if (--job.owner->pending == 0) request_done_.notify_all();
+      }
+   }
+
+   // Reads a request, returns 0 or errno.
+   int read_request(const request & job)
+   {
+      // Direct I/O needs buffers aligned to sectors, otherwise the page cache is used.
+      bool direct = direct_fd_ != -1 && reinterpret_cast<uintptr_t>(job.data) % geometry_.logical_sector == 0 &&
+                    job.size % geometry_.logical_sector == 0;
+      size_t done = 0;
+
+      while (done != job.size)
+      {
+         ssize_t readed = ::pread(direct ? direct_fd_ : fd_, job.data + done, job.size - done, job.offset + done);
+
+         if (readed < 0 && errno == EINTR) continue;
+         if (readed < 0 && errno == EINVAL && direct)
+         {
+            direct = false;
+            continue;
+         }
+         if (readed < 0) return errno;
+         if (readed == 0) return EIO;
+         done += readed;
+      }
+      return 0;
+   }
+
+   // Queues requests of a block, the mutex must be held.
+   void submit(uint64_t block)
+   {
+      uint64_t offset = block * block_size_;
+      size_t size = offset < size_ ? std::min(block_size_, size_ - offset) : 0;
+
+      slots_.push_back({ block, block_buffer(), size, 0, 0 });
+      slot & target = slots_.back();
+
+      if (spare_buffers_.empty())
+         target.buffer.resize(block_size_);
+      else
+      {
+         target.buffer.swap(spare_buffers_.back());
+         spare_buffers_.pop_back();
+      }
+
+      for (size_t done = 0; done < size; done += request_size_, target.pending++)
+         requests_.push_back({ &target, target.buffer.data() + done, std::min<size_t>(request_size_, size - done), offset + done });
+   }
+
+   // Waits for the first block in flight to be read and takes it out, the lock must hold the mutex.
+   slot complete(std::unique_lock<std::mutex> & lock)
+   {
+      request_done_.wait(lock, [this]() { return slots_.front().pending == 0; });
+
+      slot done = std::move(slots_.front());
+      slots_.pop_front();
+      return done;
+   }
+
+public:
+   device_order() : direct_fd_(-1), request_size_(0), queue_depth_(0), blocks_in_flight_(0), next_block_(0),
+                    stopped_(false)
+   { }
+
+   ~device_order()
+   {
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+         stopped_ = true;
+      }
+      request_added_.notify_all();
+      // Readers are joined before buffers of blocks in flight are freed.
+      for (auto & reader : readers_) reader.join();
+      if (direct_fd_ != -1) ::close(direct_fd_);
+   }
+
+   const device_geometry & geometry() const
+   {
+      return geometry_;
+   }
+
+   bool direct() const
+   {
+      return direct_fd_ != -1;
+   }
+
+   unsigned queue_depth() const
+   {
+      return queue_depth_;
+   }
+
+   void report(pipeline_stats &) const override
+   { }
+
+   uint64_t next_block() override
+   {
+      return next_block_++;
+   }
+
+   size_t read(uint64_t block, block_buffer & buffer) override
+   {
+      std::unique_lock<std::mutex> lock(mutex_);
+
+      // Blocks are read ahead in order, ones which are skipped are just dropped when read.
+      while (!slots_.empty() && slots_.front().block != block)
+         spare_buffers_.push_back(std::move(complete(lock).buffer));
+
+      if (slots_.empty()) submit(block);
+      for (uint64_t next = slots_.back().block + 1; slots_.size() < blocks_in_flight_ && next < std::min(block_count_, end_); next++)
+         submit(next);
+      request_added_.notify_all();
+
+      slot done = complete(lock);
+
+      // The buffer of the block is given away, the one given in exchange is used for a next block.
+      buffer.swap(done.buffer);
+      spare_buffers_.push_back(std::move(done.buffer));
+
+      if (done.error != 0) throw std::runtime_error(std::string("read error: ") + std::strerror(done.error));
+      return done.size;
+   }
+};
+
+#endif /* BLOCK_DEVICE_HPP_ */
@@ -0,0 +1,140 @@
+/*
+ * block_order.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: simonenkos
+ */
+
+#ifndef BLOCK_ORDER_HPP_
+#define BLOCK_ORDER_HPP_
+
+#include <string>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "copy.hpp"
+#include "stats.hpp"
+
+/**
+ * Order in which blocks of a regular file are read, other than the order of their ids.
+ * Blocks are read with pread(), results are put back in order by their ids on output.
+ * Blocks may be skipped by a filter, e.g. the ones which digests are already known,
+ * and the order may be limited to a range of blocks, e.g. the ones of a shard.
+ */
+class block_order
+{
+protected:
+   int fd_;
+   uint64_t size_;
+   uint64_t block_size_;
+   uint64_t block_count_;
+
+   // Number of blocks given or skipped so far, and the filter of blocks to be skipped.
+   uint64_t taken_;
+   std::function<bool(uint64_t)> skip_;
+   // Range [first, end) of blocks which are given.
+   uint64_t first_;
+   uint64_t end_;
+
+   // Prepares the order for a file which has been opened.
+   virtual bool prepare(const std::string & name) = 0;
+
+   // Returns an id of a next block in the order, each block is returned once.
+   virtual uint64_t next_block() = 0;
+
+public:
+   block_order() : fd_(-1), size_(0), block_size_(0), block_count_(0), taken_(0), first_(0),
+                   end_(std::numeric_limits<uint64_t>::max())
+   { }
+   block_order(const block_order &) = delete;
+   block_order & operator=(const block_order &) = delete;
+
+   virtual ~block_order()
+   {
+      if (fd_ != -1) ::close(fd_);
+   }
+
+   // Opens a regular file, returns false and sets errno if it can't be opened.
+   bool open(const std::string & name, uint64_t block_size)
+   {
+      struct stat st;
+
+      fd_ = ::open(name.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd_ == -1 || fstat(fd_, &st) != 0) return false;
+
+      size_ = st.st_size;
+      block_size_ = block_size;
+      // Empty file still gets a block.
+      block_count_ = std::max<uint64_t>(1, (size_ + block_size - 1) / block_size);
+      return prepare(name);
+   }
+
+   uint64_t size() const
+   {
+      return size_;
+   }
+
+   uint64_t block_count() const
+   {
+      return block_count_;
+   }
+
+   // Sets a filter, which returns true for blocks which aren't to be read.
+   void skip_blocks(std::function<bool(uint64_t)> skip)
+   {
+      skip_ = std::move(skip);
+   }
+
+   // Limits the order to blocks in [first, end), the rest of them are skipped.
+   void limit(uint64_t first, uint64_t end)
+   {
+      first_ = first;
+      end_   = end;
+   }
+
+   // Gives an id of a next block to be read, returns false after the last one.
+   bool next(uint64_t & block)
+   {
+      while (taken_ < block_count_)
+      {
+         block = next_block();
+         taken_++;
+
+         if (block >= first_ && block < end_ && (!skip_ || !skip_(block))) return true;
+      }
+      return false;
+   }
+
+   // Puts counters of the order to statistics.
+   virtual void report(pipeline_stats & stats) const = 0;
+
+   // Reads a block into a buffer, returns its size. An order may give a buffer of its own
+   // with data of the block, taking the given one in exchange.
+   virtual size_t read(uint64_t block, block_buffer & buffer)
+   {
+      char * data = buffer.data();
+      uint64_t offset = block * block_size_;
+      size_t size = offset < size_ ? std::min(block_size_, size_ - offset) : 0, done = 0;
+
+      while (done != size)
+      {
+         ssize_t readed = ::pread(fd_, data + done, size - done, offset + done);
+
+         if (readed < 0 && errno == EINTR) continue;
+         if (readed < 0) throw std::runtime_error(std::string("read error: ") + std::strerror(errno));
+         if (readed == 0) throw std::runtime_error("file has been truncated");
+         done += readed;
+      }
+      return size;
+   }
+};
+
+#endif /* BLOCK_ORDER_HPP_ */
@@ -0,0 +1,57 @@
+/*
+ * cancellation.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: simonenkos
+ */
+
+#ifndef CANCELLATION_HPP_
+#define CANCELLATION_HPP_
+
+#include <atomic>
+#include <csignal>
+
+namespace
+{
+
+// Number of a signal which requested cancellation of processing, zero if none.
+// Lock-free atomic operations are safe to be used from a signal handler.
+std::atomic<int> cancel_signal { 0 };
+
+extern "C" void cancel_handler(int signal_number)
+{
+   cancel_signal.store(signal_number, std::memory_order_relaxed);
+}
+
+}
+
+/**
+ * Installs handlers of SIGINT and SIGTERM which request cancellation of processing.
+ * Handlers are reset after the first signal, so a repeated one terminates the process
+ * immediately if the graceful cancellation takes too long for a user. System calls
+ * aren't restarted, so a read of a pipe which waits for data is interrupted by them.
+ */
+inline void install_cancel_handlers()
+{
+   struct sigaction action {};
+
+   action.sa_handler = cancel_handler;
+   action.sa_flags   = SA_RESETHAND;
+   sigemptyset(&action.sa_mask);
+
+   sigaction(SIGINT,  &action, nullptr);
+   sigaction(SIGTERM, &action, nullptr);
+}
+
+inline bool cancel_requested()
+{
+   return cancel_signal.load(std::memory_order_relaxed) != 0;
+}
+
+// Exit status of a process cancelled by a signal, as shells report it.
+inline int cancel_exit_status()
+{
+   return 128 + cancel_signal.load();
+}
+
+#endif /* CANCELLATION_HPP_ */
@@ -0,0 +1,151 @@
+/*
+ * cgroup.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: simonenkos
+ */
+
+#ifndef CGROUP_HPP_
+#define CGROUP_HPP_
+
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <thread>
+
+#include <sched.h>
+
+namespace
+{
+
+constexpr const char * CGROUP_ROOT = "/sys/fs/cgroup";
+// Memory left to the rest of the process and to the page cache of the cgroup: a share
+// of the limit, but no less than a fixed amount.
+constexpr double   CGROUP_MEMORY_MARGIN_SHARE = 0.25;
+constexpr uint64_t CGROUP_MEMORY_MARGIN_MIN   = 64 * 1024 * 1024;
+
+}
+
+/**
+ * Resources available to the process within cgroup v2 limits and its CPU affinity.
+ */
+struct resource_limits
+{
+   // Number of CPUs the process may use at once, fractional with a CPU quota.
+   double cpus;
+   // Memory which may be used for data in flight, 0 if memory isn't limited.
+   uint64_t memory_budget;
+   // Whether any cgroup limit has been found.
+   bool limited;
+};
+
+/**
+ * Reads the first line of a file, returns an empty string if it can't be read.
+ */
+inline std::string read_first_line(const std::string & path)
+{
+   std::ifstream file { path };
+   std::string line;
+
+   std::getline(file, line);
+   return line;
+}
+
+/**
+ * Returns the path of the cgroup v2 of the process within the cgroup file system,
+ * or an empty string if there is none.
+ */
+inline std::string own_cgroup_path()
+{
+   std::ifstream file { "/proc/self/cgroup" };
+   std::string line;
+
+   while (std::getline(file, line))
+   {
+      // The unified hierarchy is listed as "0::<path>".
+      if (line.compare(0, 3, "0::") == 0) return line.substr(3);
+   }
+   return std::string();
+}
+
+/**
+ * Finds limits of the process. The cgroup of the process and all of its parents are
+ * looked at, the tightest of their limits applies. Within a container, which has
+ * a cgroup namespace of its own, the cgroup is usually seen as the root.
+ */
+inline resource_limits read_resource_limits()
+{
+   resource_limits limits { static_cast<double>(std::max(1u, std::thread::hardware_concurrency())), 0, false };
+   cpu_set_t affinity;
+
+   if (sched_getaffinity(0, sizeof(affinity), &affinity) == 0)
+      limits.cpus = std::min(limits.cpus, static_cast<double>(std::max(1, CPU_COUNT(&affinity))));
+
+   std::string path = own_cgroup_path();
+   uint64_t memory_limit = std::numeric_limits<uint64_t>::max();
+
+   if (path.empty()) return limits;
+
+   while (true)
+   {
+      std::string directory = CGROUP_ROOT + path;
+      std::string cpu_max = read_first_line(directory + "/cpu.max");
+
+      // "<quota> <period>" in microseconds, the quota is "max" if there is none.
+      if (!cpu_max.empty() && cpu_max.compare(0, 3, "max") != 0)
+      {
+         double quota = std::atof(cpu_max.c_str());
+         double period = std::atof(cpu_max.c_str() + cpu_max.find(' ') + 1);
+
+         if (quota > 0 && period > 0)
+         {
+            limits.cpus = std::min(limits.cpus, quota / period);
+            limits.limited = true;
+         }
+      }
+
+      for (const char * file : { "/memory.max", "/memory.high" })
+      {
+         std::string memory_max = read_first_line(directory + file);
+
+         if (!memory_max.empty() && memory_max != "max")
+         {
+            uint64_t limit = std::strtoull(memory_max.c_str(), nullptr, 10);
+
+            if (limit < memory_limit)
+            {
+               memory_limit = limit;
+               limits.limited = true;
+            }
+         }
+      }
+
+      if (path.empty() || path == "/") break;
+      path.erase(std::max<size_t>(1, path.rfind('/')));
+      if (path == "/") path.clear();
+   }
+
+   if (memory_limit != std::numeric_limits<uint64_t>::max())
+   {
+      uint64_t margin = std::max(CGROUP_MEMORY_MARGIN_MIN, static_cast<uint64_t>(memory_limit * CGROUP_MEMORY_MARGIN_SHARE));
+
+      // Some memory is left even if the limit is tighter than the margin, a block has to fit anyway.
+      limits.memory_budget = memory_limit > margin ? memory_limit - margin : std::max<uint64_t>(1, memory_limit / 8);
+   }
+
+   return limits;
+}
+
+/**
+ * Number of hashing workers which don't oversubscribe a CPU quota, whole CPUs of it.
+ */
+inline unsigned default_workers(const resource_limits & limits)
+{
+   return std::max(1u, static_cast<unsigned>(std::floor(limits.cpus)));
+}
+
+#endif /* CGROUP_HPP_ */
@@ -0,0 +1,220 @@
+/*
+ * compare.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: simonenkos
+ */
+
+#ifndef COMPARE_HPP_
+#define COMPARE_HPP_
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <thool/thread_pool.hpp>
+
+#include "file_io.hpp"
+
+namespace
+{
+
+// Exit codes of the comparison mode, the same as cmp(1) uses.
+constexpr int COMPARE_EQUAL     = 0;
+constexpr int COMPARE_DIFFERENT = 1;
+constexpr int COMPARE_TROUBLE   = 2;
+
+constexpr uint64_t COMPARE_NO_DIFFERENCE = std::numeric_limits<uint64_t>::max();
+
+}
+
+/**
+ * State shared between the scheduler and comparison tasks. The offset of the first
+ * difference found so far also serves as a cancellation flag: blocks which start
+ * after it can't change the result, so they are neither read nor compared. So does
+ * the offset of the first block which can't be read.
+ */
+struct compare_state
+{
+   std::atomic<uint64_t> first_difference { COMPARE_NO_DIFFERENCE };
+   std::atomic<uint64_t> first_read_error { COMPARE_NO_DIFFERENCE };
+   std::atomic<uint64_t> active_tasks     { 0 };
+
+   std::mutex              mutex;
+   std::condition_variable task_done;
+
+   // Lowers an offset if a given one is less.
+   static void lower(std::atomic<uint64_t> & target, uint64_t offset)
+   {
+      uint64_t current = target.load();
+
+      while (offset < current)
+      {
+         if (target.compare_exchange_weak(current, offset)) break;
+      }
+   }
+
+   void report_difference(uint64_t offset)
+   {
+      lower(first_difference, offset);
+   }
+
+   void report_read_error(uint64_t offset)
+   {
+      lower(first_read_error, offset);
+   }
+
+   bool cancelled(uint64_t offset) const
+   {
+      return first_difference.load(std::memory_order_relaxed) <= offset ||
+             first_read_error.load(std::memory_order_relaxed) <= offset;
+   }
+};
+
+/**
+ * Compares two files block by block. Each block is read from both files with pread()
+ * and compared by a task of the thread pool, so reads of several blocks are in flight
+ * at once. The first difference found stops reading and comparison of all blocks
+ * after it. Prints the offset of the first difference and returns one of COMPARE_*
+ * exit codes.
+ */
+inline int compare_files(const std::string & first_file_name, const std::string & second_file_name, uint64_t block_size)
+{
+   std::cout << "first  file = " << first_file_name  << std::endl;
+   std::cout << "second file = " << second_file_name << std::endl;
+   std::cout << "block  size = " << block_size       << std::endl;
+
+   int first_fd  = ::open(first_file_name.c_str(),  O_RDONLY | O_CLOEXEC);
+   int second_fd = ::open(second_file_name.c_str(), O_RDONLY | O_CLOEXEC);
+   uint64_t first_size = 0, second_size = 0;
+
+   if (first_fd == -1 || second_fd == -1 || !descriptor_size(first_fd, first_size) || !descriptor_size(second_fd, second_size))
+   {
+      std::cerr << "can't open input file: " << std::strerror(errno) << std::endl;
+      if (first_fd != -1) ::close(first_fd);
+      if (second_fd != -1) ::close(second_fd);
+      return COMPARE_TROUBLE;
+   }
+
+   // Both files are read from the beginning to the end, by several tasks at once.
+   posix_fadvise(first_fd,  0, 0, POSIX_FADV_SEQUENTIAL);
+   posix_fadvise(second_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+   const uint64_t common_size = std::min(first_size, second_size);
+
+   // Limit amount of blocks being compared at once, so reads don't run far ahead
+   // of the first difference and memory of blocks in flight is bounded.
+   const uint64_t max_active_tasks = 2 * std::max(1u, std::thread::hardware_concurrency());
+
+   compare_state state;
+
+   auto & tp = thool::thread_pool::instance();
+
+   for (uint64_t offset = 0; offset < common_size; )
+   {
+      if (state.cancelled(offset)) break;
+
+      {
+         // Wait for a free slot for a next comparison task.
+         std::unique_lock<std::mutex> lock(state.mutex);
+         state.task_done.wait(lock, [&state, max_active_tasks]()
+         {
+            return state.active_tasks.load() < max_active_tasks;
+         });
+      }
+
+      uint64_t length = std::min(block_size, common_size - offset);
+
+      auto task = [first_fd, second_fd, offset, length, &state]()
+      {
+         // Skip the block if a difference was already found before it.
+         while (!state.cancelled(offset))
+         {
+            try
+            {
+               std::vector<char> first(length), second(length);
+
+               if (!read_block_at(first_fd, first.data(), length, offset) ||
+                   !read_block_at(second_fd, second.data(), length, offset))
+               {
+                  state.report_read_error(offset);
+                  break;
+               }
+
+               // memcmp is vectorised by the C library, search of an exact
+               // position is needed only for blocks that do differ.
+               if (std::memcmp(first.data(), second.data(), length) != 0)
+               {
+                  auto position = std::mismatch(first.begin(), first.end(), second.begin());
+                  state.report_difference(offset + (position.first - first.begin()));
+               }
+               break;
+            }
+            catch (const std::bad_alloc & err)
+            {
+               // Not enough memory for buffers. Wait till other tasks will be finished.
+               std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+         }
+
+         std::lock_guard<std::mutex> lock(state.mutex);
+         state.active_tasks--;
+         state.task_done.notify_all();
+      };
+
+      state.active_tasks++;
+      tp.add_task
+      (
+            std::make_shared<thool::task>(task, 0)
+      );
+      offset += length;
+   }
+
+   {
+      // Wait for all comparison tasks to be finished.
+      std::unique_lock<std::mutex> lock(state.mutex);
+      state.task_done.wait(lock, [&state]()
+      {
+         return state.active_tasks.load() == 0;
+      });
+   }
+   tp.stop();
+
+   ::close(first_fd);
+   ::close(second_fd);
+
+   // Files of different sizes with equal common part differ right after it.
+   if (first_size != second_size) state.report_difference(common_size);
+
+   uint64_t first_difference = state.first_difference.load();
+
+   // A difference before a block which can't be read is still the first one.
+   if (state.first_read_error.load() < first_difference)
+   {
+      std::cerr << "can't read input file at offset " << state.first_read_error.load() << std::endl;
+      return COMPARE_TROUBLE;
+   }
+
+   if (first_difference == COMPARE_NO_DIFFERENCE)
+   {
+      std::cout << "files are equal" << std::endl;
+      return COMPARE_EQUAL;
+   }
+
+   std::cout << "files differ at offset " << first_difference << std::endl;
+   return COMPARE_DIFFERENT;
+}
+
+#endif /* COMPARE_HPP_ */
@@ -0,0 +1,176 @@
+/*
+ * copy.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: simonenkos
+ */
+
+#ifndef COPY_HPP_
+#define COPY_HPP_
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+
+// Alignment of buffers, offsets and sizes of direct I/O, which fits logical
+// block sizes of all common devices.
+constexpr size_t DIRECT_IO_ALIGNMENT = 4096;
+
+}
+
+/**
+ * Allocator of memory aligned for direct I/O, so buffers of blocks can be
+ * written to a file opened with O_DIRECT as they are.
+ */
+template <class T>
+struct aligned_allocator
+{
+   using value_type = T;
+
+   aligned_allocator() = default;
+   template <class U>
+   aligned_allocator(const aligned_allocator<U> &)
+   { }
+
+   T * allocate(size_t count)
+   {
+      void * memory = nullptr;
+
+      if (posix_memalign(&memory, DIRECT_IO_ALIGNMENT, count * sizeof(T)) != 0)
+         throw std::bad_alloc();
+      return static_cast<T *>(memory);
+   }
+
+   void deallocate(T * memory, size_t)
+   {
+      free(memory);
+   }
+
+   template <class U>
+   bool operator==(const aligned_allocator<U> &) const { return true; }
+   template <class U>
+   bool operator!=(const aligned_allocator<U> &) const { return false; }
+};
+
+/**
+ * Buffer of a block of an input file.
+ */
+using block_buffer = std::vector<char, aligned_allocator<char>>;
+
+/**
+ * Destination of a copy of an input file, which is written block by block with
+ * positional writes, so tasks write their blocks independently in any order.
+ * Direct I/O bypasses the page cache for blocks which are aligned for it; the
+ * last partial block is written through a regular descriptor of the file.
+ */
+class copy_target
+{
+   int fd_;
+   int direct_fd_;
+   std::atomic<int> error_;
+
+public:
+   copy_target() : fd_(-1), direct_fd_(-1), error_(0)
+   { }
+   copy_target(const copy_target &) = delete;
+   copy_target & operator=(const copy_target &) = delete;
+
+   ~copy_target()
+   {
+      close();
+   }
+
+   // Creates or truncates a destination file. Returns false and sets errno if it can't be opened.
+   // Direct I/O is used only if the block size is aligned for it and the file system supports it.
+   bool open(const std::string & name, uint64_t block_size, bool direct)
+   {
+      fd_ = ::open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+      if (fd_ == -1) return false;
+
+      if (direct && block_size % DIRECT_IO_ALIGNMENT == 0)
+         direct_fd_ = ::open(name.c_str(), O_WRONLY | O_DIRECT | O_CLOEXEC);
+      return true;
+   }
+
+   bool is_open() const
+   {
+      return fd_ != -1;
+   }
+
+   bool direct() const
+   {
+      return direct_fd_ != -1;
+   }
+
+   // Writes a block at an offset. Errors are remembered, the first of them is
+   // reported by error() and all writes after it are skipped.
+   void write_block(const char * data, size_t size, uint64_t offset)
+   {
+      if (failed()) return;
+
+      bool aligned = direct() && size % DIRECT_IO_ALIGNMENT == 0 &&
+                     reinterpret_cast<uintptr_t>(data) % DIRECT_IO_ALIGNMENT == 0;
+      int fd = aligned ? direct_fd_ : fd_;
+
+      while (size != 0)
+      {
+         ssize_t written = ::pwrite(fd, data, size, offset);
+
+         if (written < 0)
+         {
+            if (errno == EINTR) continue;
+            // A file system may refuse direct I/O for a block, it's written through the page cache then.
+            if (errno == EINVAL && fd == direct_fd_)
+            {
+               fd = fd_;
+               continue;
+            }
+
+            int expected = 0;
+            error_.compare_exchange_strong(expected, errno);
+            return;
+         }
+
+         data   += written;
+         size   -= written;
+         offset += written;
+
+         // The rest of a short direct write isn't aligned anymore, it's written through the page cache.
+         if (fd == direct_fd_ && size != 0) fd = fd_;
+      }
+   }
+
+   bool failed() const
+   {
+      return error_.load(std::memory_order_relaxed) != 0;
+   }
+
+   const char * error() const
+   {
+      return std::strerror(error_.load());
+   }
+
+   // Closes the file, returns false if the copy isn't complete.
+   bool close()
+   {
+      if (direct_fd_ != -1 && ::close(direct_fd_) != 0 && !failed())
+         error_ = errno;
+      if (fd_ != -1 && ::close(fd_) != 0 && !failed())
+         error_ = errno;
+
+      fd_ = direct_fd_ = -1;
+      return !failed();
+   }
+};
+
+#endif /* COPY_HPP_ */
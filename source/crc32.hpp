@@ -0,0 +1,560 @@
+/*
+ * crc32.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: simonenkos
+ */
+
+#ifndef CRC32_HPP_
+#define CRC32_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/*
+ * Kernels of the reflected CRC32 with polynomial 0x04C11DB7, the same which is
+ * computed by boost::crc_32_type. All of them work on a raw CRC state, without
+ * initial and final inversion, so states of adjacent pieces of data can be
+ * combined by shifting the first one by the length of the second one.
+ */
+
+namespace
+{
+
+constexpr uint32_t CRC32_POLYNOMIAL = 0xEDB88320;
+
+// Range of block sizes which have specialised kernels, as powers of two (4K - 16M).
+constexpr unsigned CRC32_MIN_FIXED_ORDER = 12;
+constexpr unsigned CRC32_MAX_FIXED_ORDER = 24;
+
+// Number of independent streams a fixed size block is split into.
+constexpr size_t CRC32_FIXED_STREAMS = 4;
+
+// Blocks smaller than this are not worth waking up 512-bit units for: a core running
+// them drops its frequency for a while, which slows down everything else on it.
+constexpr size_t CRC32_AVX512_MIN_SIZE = 64 * 1024;
+
+// Small blocks are hashed in batches of independent blocks processed at once,
+// so a single CRC dependency chain doesn't limit their throughput.
+constexpr size_t CRC32_BATCH_SIZE           = 8;
+constexpr size_t CRC32_BATCH_MAX_BLOCK_SIZE = 16 * 1024;
+
+}
+
+/**
+ * Tables of slicing-by-8 algorithm: table[k][b] is a CRC state of a byte b
+ * followed by k zero bytes.
+ */
+struct crc32_tables
+{
+   uint32_t table[8][256];
+};
+
+constexpr crc32_tables make_crc32_tables()
+{
+   crc32_tables tables {};
+
+   for (uint32_t byte = 0; byte < 256; byte++)
+   {
+      uint32_t crc = byte;
+
+      for (int bit = 0; bit < 8; bit++)
+         crc = (crc & 1) ? (crc >> 1) ^ CRC32_POLYNOMIAL : crc >> 1;
+
+      tables.table[0][byte] = crc;
+   }
+
+   for (int k = 1; k < 8; k++)
+   {
+      for (uint32_t byte = 0; byte < 256; byte++)
+      {
+         uint32_t previous = tables.table[k - 1][byte];
+         tables.table[k][byte] = (previous >> 8) ^ tables.table[0][previous & 0xff];
+      }
+   }
+
+   return tables;
+}
+
+namespace
+{
+
+constexpr crc32_tables CRC32_TABLES = make_crc32_tables();
+
+}
+
+/**
+ * Multiplies two polynomials modulo the CRC polynomial in reflected representation.
+ */
+constexpr uint32_t crc32_multiply(uint32_t a, uint32_t b)
+{
+   uint32_t product = 0;
+
+   for (uint32_t mask = 1u << 31; mask != 0; mask >>= 1)
+   {
+      if (a & mask) product ^= b;
+      b = (b & 1) ? (b >> 1) ^ CRC32_POLYNOMIAL : b >> 1;
+   }
+
+   return product;
+}
+
+/**
+ * Gets x^(8 * size) modulo the CRC polynomial, which shifts a CRC state over size zero bytes.
+ */
+constexpr uint32_t crc32_shift_constant(uint64_t size)
+{
+   uint32_t result = 1u << 31;  // x^0
+   uint32_t square = 1u << 23;  // x^8
+
+   for (; size != 0; size >>= 1)
+   {
+      if (size & 1) result = crc32_multiply(result, square);
+      square = crc32_multiply(square, square);
+   }
+
+   return result;
+}
+
+/**
+ * Gets x^bits modulo the CRC polynomial in reflected representation.
+ */
+constexpr uint32_t crc32_power(uint64_t bits)
+{
+   uint32_t result = 1u << 31;  // x^0
+   uint32_t square = 1u << 30;  // x^1
+
+   for (; bits != 0; bits >>= 1)
+   {
+      if (bits & 1) result = crc32_multiply(result, square);
+      square = crc32_multiply(square, square);
+   }
+
+   return result;
+}
+
+/**
+ * Gets a 33 bit constant for carry-less multiplication, which moves a 64 bit
+ * half of reflected data forward by (bits - 32) bits: x^bits modulo the CRC
+ * polynomial, shifted left by one to account for reflection of the product.
+ */
+constexpr uint64_t crc32_fold_constant(uint64_t bits)
+{
+   return static_cast<uint64_t>(crc32_power(bits)) << 1;
+}
+
+/**
+ * Combines a CRC state of a first piece of data with a state of a second piece,
+ * computed from zero, using a shift constant of the second piece length.
+ */
+inline uint32_t crc32_combine(uint32_t first, uint32_t second, uint32_t shift_constant)
+{
+   return crc32_multiply(first, shift_constant) ^ second;
+}
+
+/**
+ * Processes 8 bytes of data with slicing-by-8 tables.
+ */
+inline uint32_t crc32_step8(uint32_t crc, const uint8_t * data)
+{
+   const auto & t = CRC32_TABLES.table;
+   uint32_t low, high;
+
+   std::memcpy(&low,  data,     sizeof(low));
+   std::memcpy(&high, data + 4, sizeof(high));
+   low ^= crc;
+
+   return t[7][low & 0xff]  ^ t[6][(low >> 8) & 0xff]  ^ t[5][(low >> 16) & 0xff]  ^ t[4][low >> 24] ^
+          t[3][high & 0xff] ^ t[2][(high >> 8) & 0xff] ^ t[1][(high >> 16) & 0xff] ^ t[0][high >> 24];
+}
+
+/**
+ * Generic kernel: updates a CRC state with data of any length.
+ */
+inline uint32_t crc32_update(uint32_t crc, const uint8_t * data, size_t size)
+{
+   for (; size >= 8; data += 8, size -= 8)
+      crc = crc32_step8(crc, data);
+
+   for (; size != 0; data++, size--)
+      crc = (crc >> 8) ^ CRC32_TABLES.table[0][(crc ^ *data) & 0xff];
+
+   return crc;
+}
+
+/**
+ * Specialised kernel for blocks of a fixed SIZE. The block is split into
+ * independent streams which are processed in one unrolled loop with a trip
+ * count known at compile time, so the dependency chains of table lookups
+ * overlap. States of streams are combined with a constant shift computed at
+ * compile time too.
+ */
+template <size_t SIZE>
+uint32_t crc32_fixed(uint32_t crc, const uint8_t * data)
+{
+   constexpr size_t   STREAM_SIZE  = SIZE / CRC32_FIXED_STREAMS;
+   constexpr uint32_t STREAM_SHIFT = crc32_shift_constant(STREAM_SIZE);
+
+   static_assert(STREAM_SIZE % 8 == 0, "a stream must consist of whole 8 byte steps");
+
+   uint32_t crc0 = crc, crc1 = 0, crc2 = 0, crc3 = 0;
+
+#pragma GCC unroll 4
+   for (size_t i = 0; i < STREAM_SIZE; i += 8)
+   {
+      crc0 = crc32_step8(crc0, data + i);
+      crc1 = crc32_step8(crc1, data + i + STREAM_SIZE);
+      crc2 = crc32_step8(crc2, data + i + 2 * STREAM_SIZE);
+      crc3 = crc32_step8(crc3, data + i + 3 * STREAM_SIZE);
+   }
+
+   crc = crc32_combine(crc0, crc1, STREAM_SHIFT);
+   crc = crc32_combine(crc,  crc2, STREAM_SHIFT);
+   return crc32_combine(crc, crc3, STREAM_SHIFT);
+}
+
+using crc32_fixed_kernel = uint32_t (*)(uint32_t, const uint8_t *);
+
+template <unsigned ORDER>
+struct crc32_fixed_kernels
+{
+   static void fill(crc32_fixed_kernel * kernels)
+   {
+      crc32_fixed_kernels<ORDER - 1>::fill(kernels);
+      kernels[ORDER - CRC32_MIN_FIXED_ORDER] = &crc32_fixed<size_t(1) << ORDER>;
+   }
+};
+
+template <>
+struct crc32_fixed_kernels<CRC32_MIN_FIXED_ORDER - 1>
+{
+   static void fill(crc32_fixed_kernel *)
+   { }
+};
+
+/**
+ * Gets a specialised kernel for blocks of a given size from a jump table indexed
+ * by the power of two, or nullptr if the size has no specialised kernel.
+ */
+inline crc32_fixed_kernel crc32_kernel_for(uint64_t size)
+{
+   struct jump_table
+   {
+      crc32_fixed_kernel kernels[CRC32_MAX_FIXED_ORDER - CRC32_MIN_FIXED_ORDER + 1];
+
+      jump_table()
+      {
+         crc32_fixed_kernels<CRC32_MAX_FIXED_ORDER>::fill(kernels);
+      }
+   };
+   static const jump_table table;
+
+   if (size == 0 || (size & (size - 1)) != 0)
+      return nullptr;
+
+   unsigned order = __builtin_ctzll(size);
+
+   if (order < CRC32_MIN_FIXED_ORDER || order > CRC32_MAX_FIXED_ORDER)
+      return nullptr;
+
+   return table.kernels[order - CRC32_MIN_FIXED_ORDER];
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("avx512f")))
+inline __m512i crc32_load512(const uint8_t * data)
+{
+   return _mm512_loadu_si512(reinterpret_cast<const void *>(data));
+}
+
+/**
+ * Folds each 128 bit lane of x forward over a distance given by constants
+ * and adds it to next data.
+ */
+__attribute__((target("avx512f,vpclmulqdq")))
+inline __m512i crc32_fold512(__m512i x, __m512i constants, __m512i next)
+{
+   return _mm512_ternarylogic_epi64(_mm512_clmulepi64_epi128(x, constants, 0x00),
+                                    _mm512_clmulepi64_epi128(x, constants, 0x11), next, 0x96);
+}
+
+__attribute__((target("pclmul,sse4.1")))
+inline __m128i crc32_fold128(__m128i x, __m128i constants, __m128i next)
+{
+   return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, constants, 0x00),
+                                      _mm_clmulepi64_si128(x, constants, 0x11)), next);
+}
+
+/**
+ * Reduces a folded 128 bit value to a 32 bit CRC state.
+ */
+__attribute__((target("pclmul,sse4.1")))
+inline uint32_t crc32_reduce128(__m128i x)
+{
+   const __m128i mask32      = _mm_set_epi32(0, 0, 0, ~0);
+   const __m128i fold_by_128 = _mm_set_epi64x(crc32_fold_constant(128 - 32), crc32_fold_constant(128 + 32));
+   const __m128i fold_by_64  = _mm_set_epi64x(0, crc32_fold_constant(64));
+   const __m128i barrett     = _mm_set_epi64x(0x1F7011641, 0x1DB710641);  // x^64 / P and P, reflected
+
+   // Fold 128 bits to 64 bits.
+   x = _mm_xor_si128(_mm_clmulepi64_si128(x, fold_by_128, 0x10), _mm_srli_si128(x, 8));
+   // Fold 64 bits to 32 bits.
+   x = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x, mask32), fold_by_64, 0x00), _mm_srli_si128(x, 4));
+
+   // Barrett reduction of the remaining 64 bit value to 32 bits.
+   __m128i t = _mm_clmulepi64_si128(_mm_and_si128(x, mask32), barrett, 0x10);
+   t = _mm_clmulepi64_si128(_mm_and_si128(t, mask32), barrett, 0x00);
+   return _mm_extract_epi32(_mm_xor_si128(t, x), 1);
+}
+
+/**
+ * Kernel folding data with VPCLMULQDQ: four 512 bit accumulators, each of four
+ * independent 128 bit lanes, are folded forward over 256 bytes per iteration,
+ * then reduced to a single 128 bit value and to a 32 bit CRC state by Barrett
+ * reduction. Bytes which don't fill 16 byte chunks are left to the generic kernel.
+ */
+__attribute__((target("avx512f,vpclmulqdq,pclmul,sse4.1")))
+inline uint32_t crc32_avx512(uint32_t crc, const uint8_t * data, size_t size)
+{
+   if (size < 256)
+      return crc32_update(crc, data, size);
+
+   // Vectors are built from zeros and explicit values, not from intrinsics which
+   // leave some lanes undefined, and which GCC reports as used uninitialized.
+   const __m512i fold_by_2048 = _mm512_set_epi64(crc32_fold_constant(2048 - 32), crc32_fold_constant(2048 + 32),
+                                                 crc32_fold_constant(2048 - 32), crc32_fold_constant(2048 + 32),
+                                                 crc32_fold_constant(2048 - 32), crc32_fold_constant(2048 + 32),
+                                                 crc32_fold_constant(2048 - 32), crc32_fold_constant(2048 + 32));
+   const __m512i fold_by_512  = _mm512_set_epi64(crc32_fold_constant(512 - 32),  crc32_fold_constant(512 + 32),
+                                                 crc32_fold_constant(512 - 32),  crc32_fold_constant(512 + 32),
+                                                 crc32_fold_constant(512 - 32),  crc32_fold_constant(512 + 32),
+                                                 crc32_fold_constant(512 - 32),  crc32_fold_constant(512 + 32));
+
+   __m512i x0 = _mm512_xor_si512(crc32_load512(data), _mm512_inserti32x4(_mm512_setzero_si512(), _mm_cvtsi32_si128(crc), 0));
+   __m512i x1 = crc32_load512(data + 64);
+   __m512i x2 = crc32_load512(data + 128);
+   __m512i x3 = crc32_load512(data + 192);
+
+   for (data += 256, size -= 256; size >= 256; data += 256, size -= 256)
+   {
+      x0 = crc32_fold512(x0, fold_by_2048, crc32_load512(data));
+      x1 = crc32_fold512(x1, fold_by_2048, crc32_load512(data + 64));
+      x2 = crc32_fold512(x2, fold_by_2048, crc32_load512(data + 128));
+      x3 = crc32_fold512(x3, fold_by_2048, crc32_load512(data + 192));
+   }
+
+   x0 = crc32_fold512(x0, fold_by_512, x1);
+   x0 = crc32_fold512(x0, fold_by_512, x2);
+   x0 = crc32_fold512(x0, fold_by_512, x3);
+
+   for (; size >= 64; data += 64, size -= 64)
+      x0 = crc32_fold512(x0, fold_by_512, crc32_load512(data));
+
+   // Fold lanes 0, 1 and 2 over the rest of lanes onto lane 3.
+   const __m512i fold_lanes = _mm512_set_epi64(0, 0,
+                                               crc32_fold_constant(128 - 32), crc32_fold_constant(128 + 32),
+                                               crc32_fold_constant(256 - 32), crc32_fold_constant(256 + 32),
+                                               crc32_fold_constant(384 - 32), crc32_fold_constant(384 + 32));
+   __m512i folded = _mm512_xor_si512(_mm512_clmulepi64_epi128(x0, fold_lanes, 0x00),
+                                     _mm512_clmulepi64_epi128(x0, fold_lanes, 0x11));
+
+   alignas(64) __m128i lanes[4], last[4];
+
+   _mm512_store_si512(lanes, folded);
+   _mm512_store_si512(last, x0);
+
+   __m128i x = _mm_xor_si128(_mm_xor_si128(lanes[0], lanes[1]), _mm_xor_si128(lanes[2], last[3]));
+
+   const __m128i fold_by_128 = _mm_set_epi64x(crc32_fold_constant(128 - 32), crc32_fold_constant(128 + 32));
+
+   for (; size >= 16; data += 16, size -= 16)
+      x = crc32_fold128(x, fold_by_128, _mm_loadu_si128(reinterpret_cast<const __m128i *>(data)));
+
+   return crc32_update(crc32_reduce128(x), data, size);
+}
+
+/**
+ * Batch kernel with PCLMULQDQ: each of STREAMS blocks has a single 128 bit
+ * accumulator, which is latency bound on carry-less multiplication by itself,
+ * so accumulators of all blocks are folded in lockstep to keep the multiplier
+ * busy. Tails are finished one by one with the generic kernel.
+ */
+template <size_t STREAMS>
+__attribute__((target("pclmul,sse4.1")))
+void crc32_interleaved_clmul(const uint8_t * const * data, const size_t * sizes, uint32_t * crcs)
+{
+   const __m128i fold_by_128 = _mm_set_epi64x(crc32_fold_constant(128 - 32), crc32_fold_constant(128 + 32));
+
+   __m128i x[STREAMS];
+   size_t common = sizes[0];
+
+   for (size_t s = 0; s < STREAMS; s++)
+      common = std::min(common, sizes[s]);
+   common &= ~size_t(15);
+
+   if (common == 0)
+   {
+      for (size_t s = 0; s < STREAMS; s++)
+         crcs[s] = ~crc32_update(~0u, data[s], sizes[s]);
+      return;
+   }
+
+   for (size_t s = 0; s < STREAMS; s++)
+      x[s] = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data[s])), _mm_cvtsi32_si128(~0u));
+
+   for (size_t i = 16; i < common; i += 16)
+   {
+#pragma GCC unroll 8
+      for (size_t s = 0; s < STREAMS; s++)
+         x[s] = crc32_fold128(x[s], fold_by_128, _mm_loadu_si128(reinterpret_cast<const __m128i *>(data[s] + i)));
+   }
+
+   for (size_t s = 0; s < STREAMS; s++)
+      crcs[s] = ~crc32_update(crc32_reduce128(x[s]), data[s] + common, sizes[s] - common);
+}
+
+inline bool crc32_clmul_supported()
+{
+   static const bool supported = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+   return supported;
+}
+
+/**
+ * Checks if the CPU supports the VPCLMULQDQ kernel.
+ */
+inline bool crc32_avx512_supported()
+{
+   static const bool supported = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("vpclmulqdq");
+   return supported;
+}
+
+#endif
+
+/**
+ * Calculates CRC32 of a block, using the fastest kernel available: VPCLMULQDQ one
+ * on CPUs which support it for large enough blocks, a specialised one if it's given
+ * and the block is full, the generic one otherwise (odd block sizes and tail blocks).
+ */
+inline uint32_t crc32_block(const void * data, size_t size, size_t block_size, crc32_fixed_kernel kernel)
+{
+   const uint8_t * bytes = static_cast<const uint8_t *>(data);
+
+#if defined(__x86_64__)
+   if (size >= CRC32_AVX512_MIN_SIZE && crc32_avx512_supported())
+      return ~crc32_avx512(~0u, bytes, size);
+#endif
+
+   if (kernel != nullptr && size == block_size)
+      return ~kernel(~0u, bytes);
+
+   return ~crc32_update(~0u, bytes, size);
+}
+
+/**
+ * Portable kernel for a batch of independent blocks: dependency chains of STREAMS blocks
+ * are interleaved step by step over their common length, so table lookups of one
+ * block are done while lookups of the others are in flight. Tails are finished
+ * one by one with the generic kernel.
+ */
+template <size_t STREAMS>
+void crc32_interleaved(const uint8_t * const * data, const size_t * sizes, uint32_t * crcs)
+{
+   uint32_t state[STREAMS];
+   size_t common = sizes[0];
+
+   for (size_t s = 0; s < STREAMS; s++)
+   {
+      state[s] = ~0u;
+      common = std::min(common, sizes[s]);
+   }
+   common &= ~size_t(7);
+
+   for (size_t i = 0; i < common; i += 8)
+   {
+#pragma GCC unroll 8
+      for (size_t s = 0; s < STREAMS; s++)
+         state[s] = crc32_step8(state[s], data[s] + i);
+   }
+
+   for (size_t s = 0; s < STREAMS; s++)
+      crcs[s] = ~crc32_update(state[s], data[s] + common, sizes[s] - common);
+}
+
+struct crc32_table_streams
+{
+   template <size_t STREAMS>
+   static void run(const uint8_t * const * data, const size_t * sizes, uint32_t * crcs)
+   {
+      crc32_interleaved<STREAMS>(data, sizes, crcs);
+   }
+};
+
+#if defined(__x86_64__)
+struct crc32_clmul_streams
+{
+   template <size_t STREAMS>
+   static void run(const uint8_t * const * data, const size_t * sizes, uint32_t * crcs)
+   {
+      crc32_interleaved_clmul<STREAMS>(data, sizes, crcs);
+   }
+};
+#endif
+
+/**
+ * Splits count blocks into groups of at most CRC32_BATCH_SIZE and hashes each
+ * group with an instantiation of a batch kernel for its size.
+ */
+template <class KERNELS>
+void crc32_interleave(const uint8_t * const * data, const size_t * sizes, size_t count, uint32_t * crcs)
+{
+   static_assert(CRC32_BATCH_SIZE == 8, "batch kernels are instantiated for up to 8 blocks");
+
+   for (; count >= 8; data += 8, sizes += 8, crcs += 8, count -= 8)
+      KERNELS::template run<8>(data, sizes, crcs);
+
+   switch (count)
+   {
+      case 7: KERNELS::template run<7>(data, sizes, crcs); break;
+      case 6: KERNELS::template run<6>(data, sizes, crcs); break;
+      case 5: KERNELS::template run<5>(data, sizes, crcs); break;
+      case 4: KERNELS::template run<4>(data, sizes, crcs); break;
+      case 3: KERNELS::template run<3>(data, sizes, crcs); break;
+      case 2: KERNELS::template run<2>(data, sizes, crcs); break;
+      case 1: KERNELS::template run<1>(data, sizes, crcs); break;
+      default: break;
+   }
+}
+
+/**
+ * Calculates CRC32 of count blocks, interleaving up to CRC32_BATCH_SIZE of them
+ * at once; blocks which have faster kernels of their own are hashed one by one.
+ */
+inline void crc32_blocks(const uint8_t * const * data, const size_t * sizes, size_t count, uint32_t * crcs,
+                         size_t block_size, crc32_fixed_kernel kernel)
+{
+   if (block_size > CRC32_BATCH_MAX_BLOCK_SIZE)
+   {
+      for (size_t i = 0; i < count; i++)
+         crcs[i] = crc32_block(data[i], sizes[i], block_size, kernel);
+      return;
+   }
+
+#if defined(__x86_64__)
+   if (crc32_clmul_supported())
+   {
+      crc32_interleave<crc32_clmul_streams>(data, sizes, count, crcs);
+      return;
+   }
+#endif
+
+   crc32_interleave<crc32_table_streams>(data, sizes, count, crcs);
+}
+
+#endif /* CRC32_HPP_ */
@@ -0,0 +1,552 @@
+/*
+ * decompress.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: simonenkos
+ */
+
+#ifndef DECOMPRESS_HPP_
+#define DECOMPRESS_HPP_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <zlib.h>
+#include <zstd.h>
+
+#include <thool/thread_pool.hpp>
+
+namespace
+{
+
+// Size of chunks of data passed from a decompressing thread to the reader
+// and how many of them may be waiting for it.
+constexpr size_t DECOMPRESS_CHUNK_SIZE    = 1024 * 1024;
+constexpr size_t DECOMPRESS_QUEUE_LENGTH  = 4;
+
+// Frames of zstd files are decompressed in parallel only if they are small enough
+// to keep several of them in memory at once.
+constexpr uint64_t ZSTD_MAX_PARALLEL_FRAME_SIZE = 64 * 1024 * 1024;
+
+constexpr uint32_t ZSTD_SKIPPABLE_MAGIC      = 0x184D2A50;
+constexpr uint32_t ZSTD_SKIPPABLE_MAGIC_MASK = 0xFFFFFFF0;
+
+}
+
+/**
+ * Source of decompressed content of an input file.
+ */
+class decompressor
+{
+public:
+   virtual ~decompressor() = default;
+
+   // Reads size bytes of decompressed data, less of them only at the end of it.
+   // Throws std::runtime_error if compressed data is corrupted.
+   virtual size_t read(char * data, size_t size) = 0;
+
+   // Size of decompressed data if it's known in advance, otherwise 0.
+   virtual uint64_t size() const
+   {
+      return 0;
+   }
+};
+
+/**
+ * Decompressor of a single stream, which can't be split, so it runs in a dedicated
+ * thread ahead of the reader and passes decompressed data in chunks through a short
+ * queue. Derived classes keep state of decompression in run() only, so they can be
+ * destroyed while the thread is being stopped.
+ */
+class stream_decompressor : public decompressor
+{
+   std::mutex mutex_;
+   std::condition_variable condition_;
+   std::deque<std::vector<char>> chunks_;
+   size_t chunk_offset_;
+   bool finished_;
+   bool stopped_;
+   std::string error_;
+   std::thread thread_;
+
+   std::ifstream input_;
+   std::string prefix_;
+
+protected:
+   // Takes an input file, which first bytes have been read already to detect its format.
+   stream_decompressor(std::ifstream && input, const std::string & prefix)
+      : chunk_offset_(0), finished_(false), stopped_(false), input_(std::move(input)), prefix_(prefix)
+   { }
+
+   // Reads compressed data, less than size bytes of it only at the end.
+   size_t read_input(char * data, size_t size)
+   {
+      size_t part = std::min(size, prefix_.size());
+
+      std::memcpy(data, prefix_.data(), part);
+      prefix_.erase(0, part);
+
+      input_.read(data + part, size - part);
+      return part + input_.gcount();
+   }
+
+   // Decompresses the whole input, passing data to push(). Throws std::runtime_error on errors.
+   virtual void run() = 0;
+
+   // Starts the thread, must be called by constructors of derived classes.
+   void start()
+   {
+      thread_ = std::thread([this]()
+      {
+         std::string error;
+
+         try
+         {
+            run();
+         }
+         catch (const std::exception & err)
+         {
+            error = err.what();
+         }
+
+         std::lock_guard<std::mutex> lock(mutex_);
+         error_    = error;
+         finished_ = true;
+         condition_.notify_all();
+      });
+   }
+
+   // Passes a chunk of decompressed data to the reader, waiting while the queue is full.
+   // Returns false if the reader doesn't need data anymore.
+   bool push(std::vector<char> && chunk)
+   {
+      std::unique_lock<std::mutex> lock(mutex_);
+
+      condition_.wait(lock, [this]() { return stopped_ || chunks_.size() < DECOMPRESS_QUEUE_LENGTH; });
+      if (stopped_) return false;
+
+      chunks_.push_back(std::move(chunk));
+      condition_.notify_all();
+      return true;
+   }
+
+public:
+   ~stream_decompressor()
+   {
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+         stopped_ = true;
+         condition_.notify_all();
+      }
+      if (thread_.joinable()) thread_.join();
+   }
+
+   size_t read(char * data, size_t size) override
+   {
+      size_t done = 0;
+      std::unique_lock<std::mutex> lock(mutex_);
+
+      while (done < size)
+      {
+         condition_.wait(lock, [this]() { return finished_ || !chunks_.empty(); });
+
+         if (chunks_.empty())
+         {
+            if (!error_.empty()) throw std::runtime_error(error_);
+            break;
+         }
+
+         auto & chunk = chunks_.front();
+         size_t part = std::min(size - done, chunk.size() - chunk_offset_);
+
+         std::memcpy(data + done, chunk.data() + chunk_offset_, part);
+         done          += part;
+         chunk_offset_ += part;
+
+         if (chunk_offset_ == chunk.size())
+         {
+            chunks_.pop_front();
+            chunk_offset_ = 0;
+            condition_.notify_all();
+         }
+      }
+      return done;
+   }
+};
+
+/**
+ * Decompressor of gzip files, including ones of several concatenated members.
+ */
+class gzip_decompressor final : public stream_decompressor
+{
+public:
+   gzip_decompressor(std::ifstream && input, const std::string & prefix) : stream_decompressor(std::move(input), prefix)
+   {
+      start();
+   }
+
+protected:
+   void run() override
+   {
+      z_stream stream {};
+
+      // Automatic detection of a gzip header.
+      if (inflateInit2(&stream, 15 + 32) != Z_OK)
+         throw std::runtime_error("can't initialize gzip decompression");
+
+      std::unique_ptr<z_stream, int (*)(z_stream *)> guard(&stream, inflateEnd);
+      std::vector<char> input(DECOMPRESS_CHUNK_SIZE);
+      std::vector<char> output(DECOMPRESS_CHUNK_SIZE);
+      int result = Z_OK;
+      bool flushing = false;
+
+      stream.next_out  = reinterpret_cast<Bytef *>(output.data());
+      stream.avail_out = output.size();
+
+      while (true)
+      {
+         // Full output may leave data inside of the decompressor, which is flushed before more input.
+         if (stream.avail_in == 0 && !flushing)
+         {
+            stream.next_in  = reinterpret_cast<Bytef *>(input.data());
+            stream.avail_in = read_input(input.data(), input.size());
+
+            if (stream.avail_in == 0) break;
+         }
+
+         // The next member of the file begins after the end of a previous one.
+         if (result == Z_STREAM_END && inflateReset(&stream) != Z_OK)
+            throw std::runtime_error("can't initialize gzip decompression");
+
+         result = inflate(&stream, Z_NO_FLUSH);
+
+         if (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR)
+            throw std::runtime_error("corrupted gzip data");
+
+         flushing = stream.avail_out == 0 && result != Z_STREAM_END;
+
+         if (stream.avail_out == 0)
+         {
+            if (!push(std::move(output))) return;
+
+            output.assign(DECOMPRESS_CHUNK_SIZE, 0);
+            stream.next_out  = reinterpret_cast<Bytef *>(output.data());
+            stream.avail_out = output.size();
+         }
+      }
+
+      if (result != Z_STREAM_END)
+         throw std::runtime_error("unexpected end of gzip data");
+
+      output.resize(output.size() - stream.avail_out);
+      if (!output.empty()) push(std::move(output));
+   }
+};
+
+/**
+ * Decompressor of zstd files, which frames are decompressed one after another.
+ */
+class zstd_stream_decompressor final : public stream_decompressor
+{
+public:
+   zstd_stream_decompressor(std::ifstream && input, const std::string & prefix) : stream_decompressor(std::move(input), prefix)
+   {
+      start();
+   }
+
+protected:
+   void run() override
+   {
+      std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx *)> context(ZSTD_createDCtx(), ZSTD_freeDCtx);
+
+      if (!context)
+         throw std::runtime_error("can't initialize zstd decompression");
+
+      std::vector<char> input(ZSTD_DStreamInSize());
+      std::vector<char> output(DECOMPRESS_CHUNK_SIZE);
+      ZSTD_inBuffer in { input.data(), 0, 0 };
+      size_t filled = 0, remaining = 0;
+      bool flushing = false;
+
+      while (true)
+      {
+         // Full output may leave data inside of the decompressor, which is flushed before more input.
+         if (in.pos == in.size && !flushing)
+         {
+            in.size = read_input(input.data(), input.size());
+            in.pos  = 0;
+
+            if (in.size == 0) break;
+         }
+
+         ZSTD_outBuffer out { output.data() + filled, output.size() - filled, 0 };
+         remaining = ZSTD_decompressStream(context.get(), &out, &in);
+
+         if (ZSTD_isError(remaining))
+            throw std::runtime_error(std::string("corrupted zstd data: ") + ZSTD_getErrorName(remaining));
+
+         filled  += out.pos;
+         flushing = filled == output.size();
+
+         if (filled == output.size())
+         {
+            if (!push(std::move(output))) return;
+
+            output.assign(DECOMPRESS_CHUNK_SIZE, 0);
+            filled = 0;
+         }
+      }
+
+      if (remaining != 0)
+         throw std::runtime_error("unexpected end of zstd data");
+
+      output.resize(filled);
+      if (!output.empty()) push(std::move(output));
+   }
+};
+
+/**
+ * Decompressor of zstd files of many frames, such as ones of the seekable format,
+ * which decompresses frames in parallel on the thread pool. A limited number of
+ * frames ahead of the reader is decompressed at once to bound memory usage.
+ */
+class zstd_frames_decompressor final : public decompressor
+{
+public:
+   struct frame
+   {
+      uint64_t offset;
+      uint64_t compressed_size;
+      uint64_t content_size;
+   };
+
+private:
+   // State shared with tasks, which may outlive the decompressor.
+   struct shared_state
+   {
+      const char * data;
+      size_t size;
+      std::vector<frame> frames;
+
+      std::mutex mutex;
+      std::condition_variable condition;
+      std::map<size_t, std::vector<char>> decompressed;
+      std::string error;
+      std::atomic<bool> stopped { false };
+
+      ~shared_state()
+      {
+         munmap(const_cast<char *>(data), size);
+      }
+   };
+
+   std::shared_ptr<shared_state> state_;
+   thool::thread_pool & pool_;
+   size_t in_flight_limit_;
+   size_t next_submitted_;
+   size_t next_frame_;
+   std::vector<char> current_;
+   size_t current_offset_;
+   uint64_t size_;
+
+   void submit(size_t index)
+   {
+      auto state = state_;
+
+      pool_.add_task
+      (
+            std::make_shared<thool::task>([state, index]()
+            {
+               if (state->stopped) return;
+
+               // Every thread of the pool keeps a context of its own.
+               thread_local std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx *)> context(ZSTD_createDCtx(), ZSTD_freeDCtx);
+
+               const frame & f = state->frames[index];
+               std::vector<char> output;
+               std::string error;
+
+               try
+               {
+                  output.resize(f.content_size);
+
+                  size_t result = ZSTD_decompressDCtx(context.get(), output.data(), output.size(),
+                                                      state->data + f.offset, f.compressed_size);
+                  if (ZSTD_isError(result))
+                     error = std::string("corrupted zstd data: ") + ZSTD_getErrorName(result);
+                  else if (result != f.content_size)
+                     error = "corrupted zstd data: wrong size of a frame";
+               }
+               catch (const std::bad_alloc & err)
+               {
+                  error = "not enough memory to decompress a frame";
+               }
+
+               std::lock_guard<std::mutex> lock(state->mutex);
+               if (!error.empty() && state->error.empty()) state->error = error;
+               state->decompressed[index] = std::move(output);
+               state->condition.notify_all();
+            }, 0)
+      );
+   }
+
+public:
+   zstd_frames_decompressor(const char * data, size_t size, std::vector<frame> && frames, thool::thread_pool & pool)
+      : state_(std::make_shared<shared_state>()), pool_(pool),
+        in_flight_limit_(2 * std::max(1u, std::thread::hardware_concurrency())),
+        next_submitted_(0), next_frame_(0), current_offset_(0), size_(0)
+   {
+      state_->data   = data;
+      state_->size   = size;
+      state_->frames = std::move(frames);
+
+      for (const auto & f : state_->frames)
+         size_ += f.content_size;
+   }
+
+   ~zstd_frames_decompressor()
+   {
+      state_->stopped = true;
+   }
+
+   uint64_t size() const override
+   {
+      return size_;
+   }
+
+   size_t read(char * data, size_t size) override
+   {
+      size_t done = 0;
+
+      while (done < size)
+      {
+         if (current_offset_ == current_.size())
+         {
+            if (next_frame_ == state_->frames.size()) break;
+
+            for (; next_submitted_ < state_->frames.size() && next_submitted_ < next_frame_ + in_flight_limit_; next_submitted_++)
+               submit(next_submitted_);
+
+            std::unique_lock<std::mutex> lock(state_->mutex);
+
+            state_->condition.wait(lock, [this]() { return state_->decompressed.count(next_frame_) != 0; });
+            if (!state_->error.empty()) throw std::runtime_error(state_->error);
+
+            auto frame = state_->decompressed.find(next_frame_++);
+            current_ = std::move(frame->second);
+            current_offset_ = 0;
+            state_->decompressed.erase(frame);
+            continue;
+         }
+
+         size_t part = std::min(size - done, current_.size() - current_offset_);
+
+         std::memcpy(data + done, current_.data() + current_offset_, part);
+         done            += part;
+         current_offset_ += part;
+      }
+      return done;
+   }
+};
+
+/**
+ * Splits zstd data to frames, skipping skippable ones, like a seek table of the
+ * seekable format. Returns false if data is corrupted or sizes of frames are unknown.
+ */
+inline bool zstd_split_frames(const char * data, size_t size, std::vector<zstd_frames_decompressor::frame> & frames)
+{
+   for (uint64_t offset = 0; offset < size; )
+   {
+      size_t compressed_size = ZSTD_findFrameCompressedSize(data + offset, size - offset);
+
+      if (ZSTD_isError(compressed_size)) return false;
+
+      uint32_t magic = 0;
+      std::memcpy(&magic, data + offset, std::min<size_t>(sizeof(magic), size - offset));
+
+      if ((magic & ZSTD_SKIPPABLE_MAGIC_MASK) != ZSTD_SKIPPABLE_MAGIC)
+      {
+         unsigned long long content_size = ZSTD_getFrameContentSize(data + offset, size - offset);
+
+         if (content_size == ZSTD_CONTENTSIZE_UNKNOWN || content_size == ZSTD_CONTENTSIZE_ERROR)
+            return false;
+
+         frames.push_back({ offset, compressed_size, content_size });
+      }
+      offset += compressed_size;
+   }
+   return true;
+}
+
+/**
+ * Opens a decompressor for a gzip or zstd file, which format is detected by its magic number.
+ * Zstd files of many frames of a known size are decompressed in parallel on the thread pool,
+ * other ones are decompressed in a dedicated thread. The file is read sequentially unless
+ * it can be mapped, so it may be a pipe. Throws std::runtime_error on errors.
+ */
+inline std::unique_ptr<decompressor> open_decompressor(const std::string & name, thool::thread_pool & pool)
+{
+   std::ifstream input { name, std::ios::binary };
+
+   if (!input.is_open())
+      throw std::runtime_error("can't open input file");
+
+   char prefix[4] = {};
+   input.read(prefix, sizeof(prefix));
+
+   const std::string magic(prefix, input.gcount());
+
+   if (magic.compare(0, 2, "\x1f\x8b") == 0)
+      return std::unique_ptr<decompressor>(new gzip_decompressor(std::move(input), magic));
+
+   if (magic != "\x28\xb5\x2f\xfd")
+      throw std::runtime_error("input file is neither gzip nor zstd");
+
+   int fd = open(name.c_str(), O_RDONLY | O_CLOEXEC);
+   struct stat st;
+
+   if (fd != -1 && fstat(fd, &st) == 0 && st.st_size > 0)
+   {
+      void * data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      close(fd);
+
+      if (data != MAP_FAILED)
+      {
+         std::vector<zstd_frames_decompressor::frame> frames;
+         bool parallel = zstd_split_frames(static_cast<const char *>(data), st.st_size, frames) && frames.size() > 1 &&
+                         std::all_of(frames.begin(), frames.end(), [](const zstd_frames_decompressor::frame & f)
+                         {
+                            return f.content_size <= ZSTD_MAX_PARALLEL_FRAME_SIZE;
+                         });
+
+         if (parallel)
+         {
+            madvise(data, st.st_size, MADV_SEQUENTIAL);
+            return std::unique_ptr<decompressor>(new zstd_frames_decompressor(static_cast<const char *>(data), st.st_size,
+                                                                              std::move(frames), pool));
+         }
+         munmap(data, st.st_size);
+      }
+   }
+   else if (fd != -1) close(fd);
+
+   return std::unique_ptr<decompressor>(new zstd_stream_decompressor(std::move(input), magic));
+}
+
+#endif /* DECOMPRESS_HPP_ */
@@ -0,0 +1,177 @@
+/*
+ * digest.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: simonenkos
+ */
+
+#ifndef DIGEST_HPP_
+#define DIGEST_HPP_
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+
+#include <boost/any.hpp>
+#include <boost/program_options.hpp>
+
+#include "blake3.hpp"
+#include "crc32.hpp"
+#include "sha256.hpp"
+
+/**
+ * Algorithms of per-block digests. Values are stored in a signature header.
+ */
+enum class hash_algorithm : uint16_t
+{
+   crc32  = 0,
+   sha256 = 1,
+   blake3 = 2
+};
+
+namespace
+{
+
+// Maximum size of a digest of any algorithm.
+constexpr size_t DIGEST_MAX_SIZE = 32;
+
+// Maximum number of blocks hashed at once by a single task.
+constexpr size_t DIGEST_BATCH_SIZE = 8;
+
+static_assert(CRC32_BATCH_SIZE <= DIGEST_BATCH_SIZE && SHA256_LANES <= DIGEST_BATCH_SIZE &&
+              BLAKE3_LANES <= DIGEST_BATCH_SIZE,
+              "batch of digests must fit batches of all kernels");
+
+}
+
+/**
+ * Digest of a single block. CRC32 is kept as uint32_t in host byte order,
+ * other digests as their bytes.
+ */
+struct block_digest
+{
+   uint8_t bytes[DIGEST_MAX_SIZE];
+};
+
+inline size_t digest_size(hash_algorithm algorithm)
+{
+   switch (algorithm)
+   {
+      case hash_algorithm::sha256: return SHA256_DIGEST_SIZE;
+      case hash_algorithm::blake3: return BLAKE3_DIGEST_SIZE;
+      default:                     return sizeof(uint32_t);
+   }
+}
+
+inline const char * hash_algorithm_name(hash_algorithm algorithm)
+{
+   switch (algorithm)
+   {
+      case hash_algorithm::sha256: return "sha256";
+      case hash_algorithm::blake3: return "blake3";
+      default:                     return "crc32";
+   }
+}
+
+/**
+ * Overload function for validation of hash_algorithm values needed for boost::program_options.
+ */
+inline void validate(boost::any & value, const std::vector<std::string> & string_values, hash_algorithm * target_type, int)
+{
+   namespace bpo = boost::program_options;
+
+   bpo::validators::check_first_occurrence(value);
+   const std::string & name = bpo::validators::get_single_string(string_values);
+
+   if      (name == "crc32")  value = boost::any(hash_algorithm::crc32);
+   else if (name == "sha256") value = boost::any(hash_algorithm::sha256);
+   else if (name == "blake3") value = boost::any(hash_algorithm::blake3);
+   else throw bpo::validation_error
+   (
+         bpo::validation_error::invalid_option_value
+   );
+}
+
+/**
+ * Calculates digests of blocks of a given size with an algorithm, choosing the
+ * fastest kernels for them once.
+ */
+class block_hasher
+{
+   hash_algorithm algorithm_;
+   uint64_t block_size_;
+   crc32_fixed_kernel crc_kernel_;
+
+public:
+   block_hasher(hash_algorithm algorithm, uint64_t block_size)
+      : algorithm_(algorithm), block_size_(block_size), crc_kernel_(crc32_kernel_for(block_size))
+   { }
+
+   hash_algorithm algorithm() const
+   {
+      return algorithm_;
+   }
+
+   // Number of blocks which is worth to give to a single task: small CRC32 blocks
+   // are interleaved, while SHA-256 without SHA extensions and BLAKE3 of blocks too
+   // small to fill AVX2 lanes by themselves are hashed by groups of 8.
+   size_t blocks_per_task() const
+   {
+      switch (algorithm_)
+      {
+         case hash_algorithm::crc32:
+            return (block_size_ <= CRC32_BATCH_MAX_BLOCK_SIZE) ? CRC32_BATCH_SIZE : 1;
+
+#if defined(__x86_64__)
+         case hash_algorithm::sha256:
+            return (!sha256_shani_supported() && sha256_avx2_supported()) ? SHA256_LANES : 1;
+#endif
+
+         case hash_algorithm::blake3:
+            return (block_size_ < BLAKE3_LANES * BLAKE3_CHUNK_SIZE && blake3_simd_supported()) ? BLAKE3_LANES : 1;
+
+         default:
+            return 1;
+      }
+   }
+
+   // Calculates digests of at most DIGEST_BATCH_SIZE blocks.
+   void hash(const uint8_t * const * data, const size_t * sizes, size_t count, block_digest * digests) const
+   {
+      switch (algorithm_)
+      {
+         case hash_algorithm::crc32:
+         {
+            uint32_t crcs[DIGEST_BATCH_SIZE];
+
+            crc32_blocks(data, sizes, count, crcs, block_size_, crc_kernel_);
+            for (size_t i = 0; i < count; i++)
+               std::memcpy(digests[i].bytes, &crcs[i], sizeof(uint32_t));
+            break;
+         }
+
+         case hash_algorithm::sha256:
+         {
+            uint8_t bytes[DIGEST_BATCH_SIZE * SHA256_DIGEST_SIZE];
+
+            sha256_messages(data, sizes, count, bytes);
+            for (size_t i = 0; i < count; i++)
+               std::memcpy(digests[i].bytes, bytes + i * SHA256_DIGEST_SIZE, SHA256_DIGEST_SIZE);
+            break;
+         }
+
+         case hash_algorithm::blake3:
+         {
+            uint8_t bytes[DIGEST_BATCH_SIZE * BLAKE3_DIGEST_SIZE];
+
+            blake3_messages(data, sizes, count, bytes);
+            for (size_t i = 0; i < count; i++)
+               std::memcpy(digests[i].bytes, bytes + i * BLAKE3_DIGEST_SIZE, BLAKE3_DIGEST_SIZE);
+            break;
+         }
+      }
+   }
+};
+
+#endif /* DIGEST_HPP_ */
@@ -0,0 +1,351 @@
+/*
+ * extent_cache.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: simonenkos
+ */
+
+#ifndef EXTENT_CACHE_HPP_
+#define EXTENT_CACHE_HPP_
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+
+#include "digest.hpp"
+#include "extents.hpp"
+
+#ifndef FS_IOC_GETFSUUID
+struct fsuuid2
+{
+   uint8_t len;
+   uint8_t uuid[16];
+};
+
+#define FS_IOC_GETFSUUID _IOR(0x15, 0, struct fsuuid2)
+#endif
+
+namespace
+{
+
+constexpr const char * EXTENT_CACHE_MAGIC = "signature-extent-cache 2";
+
+}
+
+/**
+ * Identity of a file system which a file is on. Physical offsets of extents are within the
+ * whole file system, while subvolumes and snapshots of Btrfs have devices of their own, so
+ * it's the UUID of the file system. Kernels which don't report it, and file systems made
+ * without one, give the id of statfs(), which Btrfs makes different for each subvolume,
+ * so blocks aren't shared across them then.
+ * Returns an empty string if the file can't be opened.
+ */
+inline std::string filesystem_id(const std::string & path)
+{
+   int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+   fsuuid2 uuid {};
+   struct statfs fs;
+   char hex[2 * sizeof(uuid.uuid) + 1];
+   std::string id;
+
+   if (fd == -1) return id;
+
+   if (ioctl(fd, FS_IOC_GETFSUUID, &uuid) == 0 && uuid.len != 0 && uuid.len <= sizeof(uuid.uuid) &&
+       std::any_of(uuid.uuid, uuid.uuid + uuid.len, [](uint8_t byte) { return byte != 0; }))
+   {
+      for (size_t i = 0; i < uuid.len; i++)
+         std::snprintf(hex + 2 * i, 3, "%02x", uuid.uuid[i]);
+      id = "uuid:" + std::string(hex, 2 * uuid.len);
+   }
+   else if (fstatfs(fd, &fs) == 0)
+   {
+      std::snprintf(hex, sizeof(hex), "%08x%08x", static_cast<unsigned>(fs.f_fsid.__val[0]),
+                    static_cast<unsigned>(fs.f_fsid.__val[1]));
+      id = "fsid:" + std::string(hex);
+   }
+   ::close(fd);
+   return id;
+}
+
+/**
+ * File which digests of blocks have been stored from, with its state at that time.
+ */
+struct cache_source
+{
+   std::string path;
+   uint64_t device;
+   uint64_t inode;
+   int64_t ctime_sec;
+   int64_t ctime_nsec;
+   uint64_t size;
+
+   static cache_source of(const std::string & path, const struct stat & st)
+   {
+      return { path, static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino),
+               static_cast<int64_t>(st.st_ctim.tv_sec), static_cast<int64_t>(st.st_ctim.tv_nsec),
+               static_cast<uint64_t>(st.st_size) };
+   }
+
+   // Whether the file is still the same and hasn't been changed since, so its data
+   // is still stored in the same extents.
+   bool unchanged() const
+   {
+      struct stat st;
+
+      return stat(path.c_str(), &st) == 0 && static_cast<uint64_t>(st.st_dev) == device &&
+             static_cast<uint64_t>(st.st_ino) == inode && st.st_ctim.tv_sec == ctime_sec &&
+             st.st_ctim.tv_nsec == ctime_nsec && static_cast<uint64_t>(st.st_size) == size;
+   }
+};
+
+/**
+ * Digest of data of a block at a physical offset of a file system.
+ */
+struct extent_key
+{
+   std::string filesystem;
+   uint64_t physical;
+   uint64_t length;
+   hash_algorithm algorithm;
+
+   bool operator==(const extent_key & other) const
+   {
+      return filesystem == other.filesystem && physical == other.physical && length == other.length &&
+             algorithm == other.algorithm;
+   }
+};
+
+struct extent_key_hash
+{
+   size_t operator()(const extent_key & key) const
+   {
+      return std::hash<uint64_t>()(key.physical ^ (key.length << 20) ^ static_cast<uint64_t>(key.algorithm)) ^
+             std::hash<std::string>()(key.filesystem);
+   }
+};
+
+/**
+ * Cache of digests of blocks by their physical places on storage, which is kept in a file
+ * between runs. Reflinked copies and snapshots share extents with original files, so a block
+ * of a copy which lies at the same physical offset as a signed block of an original has the
+ * same digest and doesn't have to be read.
+ *
+ * Digests are valid while their source file is unchanged: it's the same inode with the same
+ * change time and size, so its data is the one which has been signed. Digests of changed or
+ * removed files are dropped on loading. Data may still be moved to other places without
+ * a change of the file, e.g. by defragmentation or a balance of Btrfs, so a digest is given
+ * only while the source maps its logical offset to the same physical place at the moment.
+ *
+ * The file is a text with a line per source and a line per block:
+ *   source <index> <device> <inode> <ctime sec> <ctime nsec> <size> <path>
+ *   block <source index> <file system> <physical offset> <length> <algorithm> <logical offset> <hex digest>
+ */
+class extent_cache
+{
+   struct entry
+   {
+      block_digest digest;
+      size_t source;
+      // Offset of the block within the source.
+      uint64_t logical;
+   };
+
+   // Layout of a source, which is read once when it's needed first.
+   struct source_layout
+   {
+      bool read = false;
+      bool mapped = false;
+      std::vector<file_extent> extents;
+   };
+
+   std::vector<cache_source> sources_;
+   std::vector<source_layout> layouts_;
+   std::unordered_map<extent_key, entry, extent_key_hash> entries_;
+
+   const source_layout & layout(size_t source)
+   {
+      layouts_.resize(sources_.size());
+
+      source_layout & layout = layouts_[source];
+
+      if (!layout.read)
+      {
+         int fd = ::open(sources_[source].path.c_str(), O_RDONLY | O_CLOEXEC);
+
+         layout.read = true;
+         // The layout is of the data which has been signed only if the source is still unchanged.
+         layout.mapped = fd != -1 && read_extents(fd, layout.extents) && sources_[source].unchanged();
+         if (fd != -1) ::close(fd);
+      }
+      return layout;
+   }
+
+   // Checks whether a source still stores the block at its logical offset in the physical place.
+   bool still_mapped(const extent_key & key, const entry & value)
+   {
+      const source_layout & source = layout(value.source);
+      const file_extent * extent = source.mapped ? find_file_extent(source.extents, value.logical) : nullptr;
+
+      return extent != nullptr && extent->exact() && value.logical + key.length <= extent->logical + extent->length &&
+             extent->physical + (value.logical - extent->logical) == key.physical;
+   }
+
+public:
+   // Loads a cache, a missing file is an empty cache. Returns false if the file isn't a cache.
+   bool load(const std::string & path)
+   {
+      std::ifstream file { path };
+      std::string line;
+
+      if (!file.is_open()) return true;
+      if (!std::getline(file, line) || line != EXTENT_CACHE_MAGIC) return false;
+
+      // Sources are renumbered, the ones which have been changed get no number.
+      std::vector<size_t> numbers;
+
+      while (std::getline(file, line))
+      {
+         std::istringstream fields { line };
+         std::string kind;
+
+         fields >> kind;
+
+         if (kind == "source")
+         {
+            cache_source source;
+            size_t index;
+
+            if (!(fields >> index >> source.device >> source.inode >> source.ctime_sec >> source.ctime_nsec >> source.size) ||
+                index != numbers.size())
+               return false;
+
+            fields.get();
+            std::getline(fields, source.path);
+
+            numbers.push_back(source.unchanged() ? sources_.size() : SIZE_MAX);
+            if (numbers.back() != SIZE_MAX) sources_.push_back(source);
+         }
+         else if (kind == "block")
+         {
+            extent_key key;
+            size_t index;
+            uint16_t algorithm;
+            std::string hex;
+            entry value {};
+
+            if (!(fields >> index >> key.filesystem >> key.physical >> key.length >> algorithm >> value.logical >> hex) ||
+                index >= numbers.size())
+               return false;
+            if (numbers[index] == SIZE_MAX) continue;
+
+            key.algorithm = static_cast<hash_algorithm>(algorithm);
+            if (hex.size() != 2 * digest_size(key.algorithm)) return false;
+
+            for (size_t i = 0; i < hex.size(); i++)
+            {
+               char c = hex[i];
+               int nibble = (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+
+               if (nibble < 0) return false;
+               value.digest.bytes[i / 2] = static_cast<uint8_t>((value.digest.bytes[i / 2] << 4) | nibble);
+            }
+            value.source = numbers[index];
+            entries_[key] = value;
+         }
+         else return false;
+      }
+      return true;
+   }
+
+   // Saves the cache, replacing the file at once, so it's never seen half written.
+   bool save(const std::string & path) const
+   {
+      std::string temporary = path + ".tmp";
+      std::ofstream file { temporary, std::ios::trunc };
+      std::vector<size_t> numbers(sources_.size(), SIZE_MAX);
+      size_t count = 0;
+
+      // Only sources which still have blocks are kept.
+      for (const auto & item : entries_)
+      {
+         if (numbers[item.second.source] == SIZE_MAX) numbers[item.second.source] = 0;
+      }
+
+      file << EXTENT_CACHE_MAGIC << '\n';
+      for (size_t i = 0; i < sources_.size(); i++)
+      {
+         if (numbers[i] == SIZE_MAX) continue;
+
+         const cache_source & source = sources_[i];
+
+         numbers[i] = count++;
+         file << "source " << numbers[i] << ' ' << source.device << ' ' << source.inode << ' ' << source.ctime_sec << ' '
+              << source.ctime_nsec << ' ' << source.size << ' ' << source.path << '\n';
+      }
+
+      char hex[2 * DIGEST_MAX_SIZE + 1];
+
+      for (const auto & item : entries_)
+      {
+         const extent_key & key = item.first;
+         size_t size = digest_size(key.algorithm);
+
+         for (size_t i = 0; i < size; i++)
+            std::snprintf(hex + 2 * i, 3, "%02x", item.second.digest.bytes[i]);
+
+         file << "block " << numbers[item.second.source] << ' ' << key.filesystem << ' ' << key.physical << ' ' << key.length
+              << ' ' << static_cast<uint16_t>(key.algorithm) << ' ' << item.second.logical << ' ' << hex << '\n';
+      }
+
+      file.close();
+      return file && std::rename(temporary.c_str(), path.c_str()) == 0;
+   }
+
+   // Adds a source file, replacing a one of the same path, and returns its index.
+   size_t add_source(const cache_source & source)
+   {
+      layouts_.resize(sources_.size());
+
+      for (size_t i = 0; i < sources_.size(); i++)
+      {
+         if (sources_[i].path == source.path)
+         {
+            sources_[i] = source;
+            layouts_[i] = source_layout();
+            return i;
+         }
+      }
+      sources_.push_back(source);
+      return sources_.size() - 1;
+   }
+
+   // Finds a digest of a block, which its source still has in the same place.
+   bool find(const extent_key & key, block_digest & digest)
+   {
+      auto item = entries_.find(key);
+
+      if (item == entries_.end() || !still_mapped(key, item->second)) return false;
+      digest = item->second.digest;
+      return true;
+   }
+
+   void add(const extent_key & key, const block_digest & digest, size_t source, uint64_t logical)
+   {
+      entries_[key] = entry { digest, source, logical };
+   }
+};
+
+#endif /* EXTENT_CACHE_HPP_ */
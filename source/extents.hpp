@@ -0,0 +1,209 @@
+/*
+ * extents.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: simonenkos
+ */
+
+#ifndef EXTENTS_HPP_
+#define EXTENTS_HPP_
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <deque>
+#include <limits>
+
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+
+#include "block_order.hpp"
+
+namespace
+{
+
+// Blocks are sorted by physical offsets within logical windows of this size, which bounds
+// the number of results held out of order till the blocks before them are hashed.
+constexpr uint64_t EXTENT_REORDER_WINDOW = 1024 * 1024 * 1024;
+// Number of extents asked from the file system at once.
+constexpr uint32_t EXTENT_BATCH = 256;
+// Flags of extents which data isn't stored as is at a known physical offset.
+constexpr uint32_t EXTENT_NOT_EXACT = FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DELALLOC | FIEMAP_EXTENT_ENCODED |
+                                      FIEMAP_EXTENT_DATA_ENCRYPTED | FIEMAP_EXTENT_NOT_ALIGNED | FIEMAP_EXTENT_DATA_INLINE |
+                                      FIEMAP_EXTENT_DATA_TAIL | FIEMAP_EXTENT_UNWRITTEN;
+
+}
+
+/**
+ * Extent of a file: a range of logical offsets and the physical offset it starts at.
+ */
+struct file_extent
+{
+   uint64_t logical;
+   uint64_t physical;
+   uint64_t length;
+   // FIEMAP_EXTENT_* flags.
+   uint32_t flags;
+
+   // Location of data isn't known, e.g. it's not allocated yet or it's inline.
+   bool unknown() const
+   {
+      return flags & (FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DATA_INLINE);
+   }
+
+   // Data is stored as is at the physical offset, so the offset identifies it.
+   bool exact() const
+   {
+      return !(flags & EXTENT_NOT_EXACT);
+   }
+
+   // Data is shared with other files, e.g. reflinked copies or snapshots.
+   bool shared() const
+   {
+      return flags & FIEMAP_EXTENT_SHARED;
+   }
+};
+
+/**
+ * Finds an extent of a sorted layout of a file, which holds a logical offset. Returns nullptr if
+ * there is no such extent, e.g. the offset is within a hole.
+ */
+inline const file_extent * find_file_extent(const std::vector<file_extent> & extents, uint64_t offset)
+{
+   auto extent = std::upper_bound(extents.begin(), extents.end(), offset,
+                                  [](uint64_t value, const file_extent & extent) { return value < extent.logical; });
+
+   if (extent == extents.begin()) return nullptr;
+   --extent;
+   return offset < extent->logical + extent->length ? &*extent : nullptr;
+}
+
+/**
+ * Queries layout of a file on storage with the FIEMAP ioctl. Returns false if the file
+ * system doesn't support it.
+ */
+inline bool read_extents(int fd, std::vector<file_extent> & extents)
+{
+   std::vector<uint8_t> buffer(sizeof(fiemap) + EXTENT_BATCH * sizeof(fiemap_extent));
+   auto map = reinterpret_cast<fiemap *>(buffer.data());
+   uint64_t start = 0;
+
+   while (true)
+   {
+      std::fill(buffer.begin(), buffer.end(), 0);
+      map->fm_start = start;
+      map->fm_length = FIEMAP_MAX_OFFSET - start;
+      // Delayed allocations are flushed, so they get their places.
+      map->fm_flags = FIEMAP_FLAG_SYNC;
+      map->fm_extent_count = EXTENT_BATCH;
+
+      if (ioctl(fd, FS_IOC_FIEMAP, map) != 0) return false;
+      if (map->fm_mapped_extents == 0) return true;
+
+      for (uint32_t i = 0; i < map->fm_mapped_extents; i++)
+      {
+         const fiemap_extent & extent = map->fm_extents[i];
+
+         extents.push_back({ extent.fe_logical, extent.fe_physical, extent.fe_length, extent.fe_flags });
+
+         if (extent.fe_flags & FIEMAP_EXTENT_LAST) return true;
+         start = extent.fe_logical + extent.fe_length;
+      }
+   }
+}
+
+/**
+ * Order of reading blocks of a file by physical offsets of their data, so a fragmented
+ * file is read with as few seeks as possible. Blocks are sorted within windows of logical
+ * offsets only, so results of a pathological layout don't pile up in memory waiting
+ * for blocks of the lowest ids. Blocks which are holes go first, since they cost
+ * no reading, and blocks of unknown location go last in their logical order.
+ */
+class extent_order : public block_order
+{
+   std::vector<file_extent> extents_;
+   bool mapped_;
+   uint64_t window_blocks_;
+   uint64_t sorted_end_;
+   std::deque<uint64_t> blocks_;
+
+   bool prepare(const std::string &) override
+   {
+      mapped_ = read_extents(fd_, extents_);
+      window_blocks_ = std::max<uint64_t>(1, EXTENT_REORDER_WINDOW / block_size_);
+      return true;
+   }
+
+   // Extent which contains a logical offset, nullptr for a hole.
+   const file_extent * find_extent(uint64_t offset) const
+   {
+      return find_file_extent(extents_, offset);
+   }
+
+   // Physical offset of the first byte of a block.
+   uint64_t physical_offset(uint64_t block) const
+   {
+      uint64_t offset = block * block_size_;
+      const file_extent * extent = find_extent(offset);
+
+      if (extent == nullptr) return 0;
+      if (extent->unknown()) return std::numeric_limits<uint64_t>::max();
+      return extent->physical + (offset - extent->logical);
+   }
+
+public:
+   extent_order() : mapped_(false), window_blocks_(0), sorted_end_(0)
+   { }
+
+   // Whether the layout of the file is known, blocks are read in order of their ids otherwise.
+   bool mapped() const
+   {
+      return mapped_;
+   }
+
+   // Finds a physical offset of a block, which data is stored as is within a single extent.
+   // Returns nullptr if there is no such extent, otherwise the extent.
+   const file_extent * physical_block(uint64_t block, uint64_t & physical) const
+   {
+      uint64_t offset = block * block_size_;
+      uint64_t end = std::min(size_, offset + block_size_);
+      const file_extent * extent = find_extent(offset);
+
+      if (extent == nullptr || !extent->exact() || end > extent->logical + extent->length || end == offset)
+         return nullptr;
+
+      physical = extent->physical + (offset - extent->logical);
+      return extent;
+   }
+
+   void report(pipeline_stats & stats) const override
+   {
+      stats.extents = extents_.size();
+   }
+
+   uint64_t next_block() override
+   {
+      if (blocks_.empty())
+      {
+         uint64_t last = std::min(block_count_, sorted_end_ + window_blocks_);
+         std::vector<std::pair<uint64_t, uint64_t>> window;
+
+         for (uint64_t block = sorted_end_; block < last; block++)
+            window.push_back({ mapped_ ? physical_offset(block) : 0, block });
+
+         // Ids break ties, so blocks of the same place keep their logical order.
+         std::sort(window.begin(), window.end());
+         for (const auto & block : window)
+            blocks_.push_back(block.second);
+         sorted_end_ = last;
+      }
+
+      uint64_t block = blocks_.front();
+
+      blocks_.pop_front();
+      return block;
+   }
+};
+
+#endif /* EXTENTS_HPP_ */
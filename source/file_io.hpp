@@ -0,0 +1,104 @@
+/*
+ * file_io.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: simonenkos
+ */
+
+#ifndef FILE_IO_HPP_
+#define FILE_IO_HPP_
+
+#include <string>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <unistd.h>
+
+#include "cancellation.hpp"
+
+/**
+ * Gets a size of a stream opened for reading and rewinds it to the beginning. Returns false
+ * if the stream can't seek, e.g. it's a pipe: its size is unknown and it's left as it is.
+ */
+inline bool stream_size(std::ifstream & stream, uint64_t & size)
+{
+   stream.seekg(0, std::ios::end);
+   std::streampos end = stream.tellg();
+
+   if (end == std::streampos(-1))
+   {
+      stream.clear();
+      return false;
+   }
+
+   stream.seekg(0, std::ios::beg);
+   size = static_cast<uint64_t>(end);
+   return true;
+}
+
+/**
+ * Gets a size of an open file, also of a block device, which has no size in its stat.
+ * Returns false if it can't seek.
+ */
+inline bool descriptor_size(int fd, uint64_t & size)
+{
+   off_t end = ::lseek(fd, 0, SEEK_END);
+
+   if (end < 0) return false;
+
+   size = static_cast<uint64_t>(end);
+   return true;
+}
+
+/**
+ * Reads a whole block of a file at an offset, returns false and sets errno if it can't be read.
+ */
+inline bool read_block_at(int fd, char * data, size_t size, uint64_t offset)
+{
+   size_t done = 0;
+
+   while (done != size)
+   {
+      ssize_t readed = ::pread(fd, data + done, size - done, offset + done);
+
+      if (readed < 0 && errno == EINTR) continue;
+      if (readed < 0) return false;
+      if (readed == 0)
+      {
+         errno = EIO;
+         return false;
+      }
+      done += readed;
+   }
+   return true;
+}
+
+/**
+ * Reads a stream, e.g. a pipe, which gives data in parts, till size bytes are read or it ends.
+ * A read interrupted by cancellation gives up with data read so far. Returns the number of
+ * bytes read, throws std::runtime_error on errors.
+ */
+inline size_t read_stream(int fd, char * data, size_t size)
+{
+   size_t done = 0;
+
+   while (done != size)
+   {
+      ssize_t readed = ::read(fd, data + done, size - done);
+
+      if (readed < 0 && errno == EINTR)
+      {
+         if (cancel_requested()) break;
+         continue;
+      }
+      if (readed < 0) throw std::runtime_error(std::strerror(errno));
+      if (readed == 0) break;
+      done += readed;
+   }
+   return done;
+}
+
+#endif /* FILE_IO_HPP_ */
@@ -0,0 +1,83 @@
+/*
+ * mapped_file.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: simonenkos
+ */
+
+#ifndef MAPPED_FILE_HPP_
+#define MAPPED_FILE_HPP_
+
+#include <string>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * File mapped to memory for reading.
+ */
+class mapped_file
+{
+   const uint8_t * data_;
+   size_t size_;
+
+public:
+   mapped_file() : data_(nullptr), size_(0)
+   { }
+   mapped_file(const mapped_file &) = delete;
+   mapped_file & operator=(const mapped_file &) = delete;
+
+   ~mapped_file()
+   {
+      if (data_ != nullptr) munmap(const_cast<uint8_t *>(data_), size_);
+   }
+
+   // Maps a whole file, returns false and sets errno if it can't be mapped.
+   // An empty file is mapped with no data.
+   bool open(const std::string & name, int advice = MADV_NORMAL)
+   {
+      int fd = ::open(name.c_str(), O_RDONLY | O_CLOEXEC);
+      struct stat st;
+
+      if (fd == -1) return false;
+      if (fstat(fd, &st) != 0)
+      {
+         close(fd);
+         return false;
+      }
+
+      size_ = st.st_size;
+
+      if (size_ != 0)
+      {
+         void * data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+
+         if (data == MAP_FAILED)
+         {
+            close(fd);
+            size_ = 0;
+            return false;
+         }
+         data_ = static_cast<const uint8_t *>(data);
+         madvise(data, size_, advice);
+      }
+
+      close(fd);
+      return true;
+   }
+
+   const uint8_t * data() const
+   {
+      return data_;
+   }
+
+   size_t size() const
+   {
+      return size_;
+   }
+};
+
+#endif /* MAPPED_FILE_HPP_ */
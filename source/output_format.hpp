@@ -0,0 +1,418 @@
+/*
+ * output_format.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: simonenkos
+ */
+
+#ifndef OUTPUT_FORMAT_HPP_
+#define OUTPUT_FORMAT_HPP_
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <cstring>
+#include <cstdint>
+
+#include <boost/any.hpp>
+#include <boost/program_options.hpp>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "digest.hpp"
+
+/**
+ * Result of processing of a single block of an input file.
+ */
+struct block_result
+{
+   block_digest digest;
+   uint64_t length;
+};
+
+/**
+ * Formats of a signature file:
+ *  raw   - binary stream of digests: CRC32 as uint32_t in host byte order, others as bytes;
+ *          as it always has been, an input which size is a multiple of the block size
+ *          ends with a digest of an empty block, other formats have no such record;
+ *  sig   - the raw stream preceded by a signature_header;
+ *  hex   - one hex digest per line;
+ *  jsonl - JSON object with offset, length and digest per line;
+ *  sum   - manifest laid out like output of *sum utilities, "<digest>  <input>@<offset>"
+ *          per block; it can't be checked by them, as blocks aren't files.
+ */
+enum class output_format
+{
+   raw,
+   sig,
+   hex,
+   jsonl,
+   sum
+};
+
+/**
+ * Header of a signature file of the sig format. Fields are stored in host byte
+ * order. The header is written with no flags set before processing and updated
+ * when it's finished, so a signature of an interrupted run is either marked as
+ * partial, covering block_count blocks, or has no flags at all. A shard covers
+ * block_count blocks of the input, which is told by input_id, till shards are merged.
+ */
+struct signature_header
+{
+   char     magic[8];
+   uint16_t version;
+   uint16_t algorithm;
+   uint32_t digest_size;
+   uint64_t block_size;
+   uint64_t block_count;
+   uint64_t covered_size;
+   uint32_t flags;
+   // Shards only: index of the shard and the number of them, identity of the input, which
+   // is the same for shards of the same state of a file, and its size. Other signatures have zeros.
+   uint16_t shard_index;
+   uint16_t shard_count;
+   uint64_t input_id;
+   uint64_t input_size;
+};
+
+static_assert(sizeof(signature_header) == 64, "signature header must be 64 bytes");
+
+namespace
+{
+
+const char SIGNATURE_MAGIC[8] = { 'S', 'I', 'G', 'N', 'A', 'T', 'U', 'R' };
+
+constexpr uint16_t SIGNATURE_VERSION = 1;
+
+constexpr uint32_t SIGNATURE_COMPLETE = 1 << 0;
+constexpr uint32_t SIGNATURE_PARTIAL  = 1 << 1;
+constexpr uint32_t SIGNATURE_SHARD    = 1 << 2;
+
+}
+
+/**
+ * Overload function for validation of output_format values needed for boost::program_options.
+ */
+inline void validate(boost::any & value, const std::vector<std::string> & string_values, output_format * target_type, int)
+{
+   namespace bpo = boost::program_options;
+
+   bpo::validators::check_first_occurrence(value);
+   const std::string & name = bpo::validators::get_single_string(string_values);
+
+   if      (name == "raw")   value = boost::any(output_format::raw);
+   else if (name == "sig")   value = boost::any(output_format::sig);
+   else if (name == "hex")   value = boost::any(output_format::hex);
+   else if (name == "jsonl") value = boost::any(output_format::jsonl);
+   else if (name == "sum")   value = boost::any(output_format::sum);
+   else throw bpo::validation_error
+   (
+         bpo::validation_error::invalid_option_value
+   );
+}
+
+/**
+ * Encodes size bytes of data as lowercase hex digits into output, which must
+ * have room for 2 * size characters.
+ */
+inline void hex_encode(const uint8_t * data, size_t size, char * output)
+{
+   static const char digits[] = "0123456789abcdef";
+   size_t i = 0;
+
+#if defined(__SSE2__)
+   // Convert 16 bytes at once: split them to nibbles, turn nibbles to ASCII
+   // by adding '0' and an extra ('a' - '0' - 10) to those above 9, and interleave
+   // high and low nibbles back to the order of digits.
+   const __m128i low_mask = _mm_set1_epi8(0x0f);
+   const __m128i nine     = _mm_set1_epi8(9);
+   const __m128i zero     = _mm_set1_epi8('0');
+   const __m128i letters  = _mm_set1_epi8('a' - '0' - 10);
+
+   for (; i + 16 <= size; i += 16)
+   {
+      __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+      __m128i high  = _mm_and_si128(_mm_srli_epi16(bytes, 4), low_mask);
+      __m128i low   = _mm_and_si128(bytes, low_mask);
+
+      high = _mm_add_epi8(_mm_add_epi8(high, zero), _mm_and_si128(_mm_cmpgt_epi8(high, nine), letters));
+      low  = _mm_add_epi8(_mm_add_epi8(low,  zero), _mm_and_si128(_mm_cmpgt_epi8(low,  nine), letters));
+
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(output + 2 * i),      _mm_unpacklo_epi8(high, low));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(output + 2 * i + 16), _mm_unpackhi_epi8(high, low));
+   }
+#endif
+
+   for (; i < size; i++)
+   {
+      output[2 * i]     = digits[data[i] >> 4];
+      output[2 * i + 1] = digits[data[i] & 0x0f];
+   }
+}
+
+/**
+ * Appends decimal representation of a number to a string.
+ */
+inline void append_decimal(std::string & output, uint64_t number)
+{
+   char buffer[20];
+   char * end = buffer + sizeof(buffer);
+   char * position = end;
+
+   do
+   {
+      *--position = '0' + number % 10;
+      number /= 10;
+   }
+   while (number != 0);
+
+   output.append(position, end);
+}
+
+/**
+ * Writer of block results into an output stream according to a format. Results
+ * are formatted in batches, so the output stream gets a single write per batch.
+ */
+class signature_writer
+{
+   std::ostream & output_;
+   output_format format_;
+   hash_algorithm algorithm_;
+   size_t digest_size_;
+   uint64_t block_size_;
+   std::string input_name_;
+
+   uint64_t next_block_id_;
+   uint64_t covered_size_;
+   std::streampos header_position_;
+
+   // The raw format keeps a digest of an empty block after the last full one.
+   bool empty_block_trailer_;
+
+   // Shard of a signature of the whole input, which this one is, if the count isn't zero.
+   unsigned shard_index_;
+   unsigned shard_count_;
+   uint64_t input_id_;
+   uint64_t input_size_;
+
+   std::vector<uint8_t> digests_;
+   std::vector<char> hex_;
+   std::string text_;
+
+public:
+   signature_writer(std::ostream & output, output_format format, hash_algorithm algorithm, uint64_t block_size,
+                    const std::string & input_name)
+      : output_(output), format_(format), algorithm_(algorithm), digest_size_(digest_size(algorithm)),
+        block_size_(block_size), input_name_(input_name), next_block_id_(0), covered_size_(0),
+        header_position_(0), empty_block_trailer_(format == output_format::raw), shard_index_(0), shard_count_(0),
+        input_id_(0), input_size_(0)
+   { }
+
+   uint64_t blocks_written() const
+   {
+      return next_block_id_;
+   }
+
+   // Makes the signature of the sig format a shard of a signature of the whole input.
+   void shard(unsigned index, unsigned count, uint64_t input_id, uint64_t input_size)
+   {
+      shard_index_ = index;
+      shard_count_ = count;
+      input_id_    = input_id;
+      input_size_  = input_size;
+   }
+
+   // Turns off the record of an empty block of the raw format, for signatures which have
+   // never had it.
+   void disable_empty_block_trailer()
+   {
+      empty_block_trailer_ = false;
+   }
+
+   // Starts a next signature in the same output, for another input.
+   void restart(const std::string & input_name)
+   {
+      input_name_    = input_name;
+      next_block_id_ = 0;
+      covered_size_  = 0;
+   }
+
+   // Writes a beginning of the output, which is a header for the sig format.
+   void begin()
+   {
+      if (format_ == output_format::sig)
+      {
+         header_position_ = output_.tellp();
+         write_header(0);
+      }
+   }
+
+   // Continues a signature of the sig format at the beginning of the output, which already has
+   // digests of blocks covering covered_size bytes. The header is marked as unfinished again
+   // and the output is positioned after the digests, anything after them is overwritten.
+   void resume(uint64_t blocks, uint64_t covered_size)
+   {
+      header_position_ = 0;
+      next_block_id_   = blocks;
+      covered_size_    = covered_size;
+
+      output_.seekp(header_position_);
+      write_header(0);
+      output_.seekp(sizeof(signature_header) + blocks * digest_size_);
+      output_.flush();
+   }
+
+   // Finishes the output. A partial one gets a marker of how many blocks it covers:
+   // in the header for the sig format and in a trailing line for the jsonl format.
+   void finish(bool complete)
+   {
+      if (format_ == output_format::raw && empty_block_trailer_ && complete && next_block_id_ != 0 &&
+          covered_size_ == next_block_id_ * block_size_)
+      {
+         // Signatures of the raw format have always had a record of the empty read which ends
+         // an input of a multiple of the block size, so they are compared with ones made before.
+         const block_hasher hasher { algorithm_, block_size_ };
+         static const uint8_t empty = 0;
+         const uint8_t * data = &empty;
+         size_t size = 0;
+         block_digest digest;
+
+         hasher.hash(&data, &size, 1, &digest);
+         output_.write(reinterpret_cast<const char *>(digest.bytes), digest_size_);
+      }
+      else if (format_ == output_format::sig)
+      {
+         auto end = output_.tellp();
+
+         output_.seekp(header_position_);
+         write_header(complete ? SIGNATURE_COMPLETE : SIGNATURE_PARTIAL);
+         output_.seekp(end);
+      }
+      else if (format_ == output_format::jsonl && !complete)
+      {
+         text_.assign("{\"partial\":true,\"blocks\":");
+         append_decimal(text_, next_block_id_);
+         text_.append(",\"length\":");
+         append_decimal(text_, covered_size_);
+         text_.append("}\n");
+         output_.write(text_.data(), text_.size());
+      }
+      output_.flush();
+   }
+
+   // Writes results of blocks following the ones written before.
+   void write(const std::vector<block_result> & batch)
+   {
+      if (batch.empty()) return;
+
+      for (const auto & result : batch)
+         covered_size_ += result.length;
+
+      if (format_ == output_format::raw || format_ == output_format::sig)
+      {
+         digests_.resize(batch.size() * digest_size_);
+
+         for (size_t i = 0; i < batch.size(); i++)
+            std::memcpy(&digests_[i * digest_size_], batch[i].digest.bytes, digest_size_);
+
+         output_.write(reinterpret_cast<const char *>(digests_.data()), digests_.size());
+         next_block_id_ += batch.size();
+         return;
+      }
+
+      // Checksums are printed as numbers, so put their bytes in big-endian order,
+      // other digests are printed as bytes. The whole batch is encoded at once.
+      digests_.resize(batch.size() * digest_size_);
+
+      for (size_t i = 0; i < batch.size(); i++)
+      {
+         uint8_t * digest = &digests_[i * digest_size_];
+
+         if (algorithm_ == hash_algorithm::crc32)
+         {
+            uint32_t crc;
+
+            std::memcpy(&crc, batch[i].digest.bytes, sizeof(crc));
+            digest[0] = crc >> 24;
+            digest[1] = crc >> 16;
+            digest[2] = crc >> 8;
+            digest[3] = crc;
+         }
+         else std::memcpy(digest, batch[i].digest.bytes, digest_size_);
+      }
+
+      hex_.resize(digests_.size() * 2);
+      hex_encode(digests_.data(), digests_.size(), hex_.data());
+
+      const size_t digest_length = 2 * digest_size_;
+      text_.clear();
+
+      for (size_t i = 0; i < batch.size(); i++)
+      {
+         const char * digest = &hex_[i * digest_length];
+         uint64_t offset = (next_block_id_ + i) * block_size_;
+
+         switch (format_)
+         {
+            case output_format::hex:
+               text_.append(digest, digest_length);
+               break;
+
+            case output_format::jsonl:
+               text_.append("{\"offset\":");
+               append_decimal(text_, offset);
+               text_.append(",\"length\":");
+               append_decimal(text_, batch[i].length);
+               text_.append(",\"digest\":\"");
+               text_.append(digest, digest_length);
+               text_.append("\"}");
+               break;
+
+            case output_format::sum:
+               text_.append(digest, digest_length);
+               text_.append("  ");
+               text_.append(input_name_);
+               text_.push_back('@');
+               append_decimal(text_, offset);
+               break;
+
+            default:
+               break;
+         }
+         text_.push_back('\n');
+      }
+
+      output_.write(text_.data(), text_.size());
+      next_block_id_ += batch.size();
+   }
+
+private:
+   void write_header(uint32_t flags)
+   {
+      signature_header header {};
+
+      std::memcpy(header.magic, SIGNATURE_MAGIC, sizeof(header.magic));
+      header.version      = SIGNATURE_VERSION;
+      header.algorithm    = static_cast<uint16_t>(algorithm_);
+      header.digest_size  = digest_size_;
+      header.block_size   = block_size_;
+      header.block_count  = next_block_id_;
+      header.covered_size = covered_size_;
+      header.flags        = flags;
+
+      if (shard_count_ != 0)
+      {
+         header.flags      |= SIGNATURE_SHARD;
+         header.shard_index = shard_index_;
+         header.shard_count = shard_count_;
+         header.input_id    = input_id_;
+         header.input_size  = input_size_;
+      }
+
+      output_.write(reinterpret_cast<const char *>(&header), sizeof(header));
+   }
+};
+
+#endif /* OUTPUT_FORMAT_HPP_ */
@@ -0,0 +1,145 @@
+/*
+ * progress.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: simonenkos
+ */
+
+#ifndef PROGRESS_HPP_
+#define PROGRESS_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+#include <unistd.h>
+
+namespace
+{
+
+constexpr int PROGRESS_TERMINAL_REFRESH_MS = 250;
+constexpr int PROGRESS_PERIODIC_REFRESH_MS = 1000;
+
+}
+
+/**
+ * Counters of the processing pipeline. They are updated by the reader and the
+ * writer stage with relaxed atomic operations only, so keeping them costs the
+ * hot path neither locks nor system calls.
+ */
+struct progress_counters
+{
+   std::atomic<uint64_t> bytes_read     { 0 };
+   std::atomic<uint64_t> blocks_read    { 0 };
+   std::atomic<uint64_t> bytes_written  { 0 };
+   std::atomic<uint64_t> blocks_written { 0 };
+
+   void block_read(uint64_t size)
+   {
+      bytes_read.fetch_add(size, std::memory_order_relaxed);
+      blocks_read.fetch_add(1, std::memory_order_relaxed);
+   }
+
+   void blocks_saved(uint64_t count, uint64_t size)
+   {
+      bytes_written.fetch_add(size, std::memory_order_relaxed);
+      blocks_written.fetch_add(count, std::memory_order_relaxed);
+   }
+};
+
+/**
+ * Thread which periodically renders progress counters to stderr. On a terminal
+ * it redraws a single status line, otherwise it prints machine-readable lines
+ * of key=value pairs.
+ */
+class progress_reporter
+{
+   const progress_counters & counters_;
+   uint64_t total_bytes_;
+   bool terminal_;
+
+   std::mutex mutex_;
+   std::condition_variable stop_requested_;
+   bool stopped_;
+   std::thread thread_;
+
+   std::chrono::steady_clock::time_point start_time_;
+   std::chrono::steady_clock::time_point last_time_;
+   uint64_t last_bytes_;
+   double rate_;
+
+   void report(bool final)
+   {
+      auto now = std::chrono::steady_clock::now();
+      uint64_t bytes     = counters_.bytes_written.load(std::memory_order_relaxed);
+      uint64_t in_flight = counters_.blocks_read.load(std::memory_order_relaxed) -
+                           counters_.blocks_written.load(std::memory_order_relaxed);
+
+      // Smooth the rate a bit, so ETA doesn't jump on every refresh.
+      double interval = std::chrono::duration<double>(now - last_time_).count();
+      if (interval > 0)
+      {
+         double current_rate = (bytes - last_bytes_) / interval;
+         rate_ = (last_bytes_ == 0 && rate_ == 0) ? current_rate : 0.7 * rate_ + 0.3 * current_rate;
+      }
+      last_time_  = now;
+      last_bytes_ = bytes;
+
+      double elapsed = std::chrono::duration<double>(now - start_time_).count();
+      long eta = (rate_ > 0 && total_bytes_ > bytes) ? static_cast<long>((total_bytes_ - bytes) / rate_) : 0;
+
+      if (terminal_)
+      {
+         std::fprintf(stderr, "\r%10.1f / %.1f MB (%3d%%) %9.1f MB/s  in-flight %5llu  ETA %ld:%02ld:%02ld\033[K%s",
+                      bytes / 1e6, total_bytes_ / 1e6,
+                      total_bytes_ ? static_cast<int>(100 * bytes / total_bytes_) : 100,
+                      rate_ / 1e6, static_cast<unsigned long long>(in_flight),
+                      eta / 3600, eta / 60 % 60, eta % 60, final ? "\n" : "");
+      }
+      else
+      {
+         std::fprintf(stderr, "progress bytes=%llu total=%llu rate=%.0f in_flight=%llu elapsed=%.1f eta=%ld\n",
+                      static_cast<unsigned long long>(bytes), static_cast<unsigned long long>(total_bytes_),
+                      rate_, static_cast<unsigned long long>(in_flight), elapsed, eta);
+      }
+      std::fflush(stderr);
+   }
+
+public:
+   progress_reporter(const progress_counters & counters, uint64_t total_bytes)
+      : counters_(counters), total_bytes_(total_bytes), terminal_(isatty(STDERR_FILENO)), stopped_(false),
+        start_time_(std::chrono::steady_clock::now()), last_time_(start_time_), last_bytes_(0), rate_(0)
+   {
+      thread_ = std::thread([this]()
+      {
+         auto period = std::chrono::milliseconds(terminal_ ? PROGRESS_TERMINAL_REFRESH_MS : PROGRESS_PERIODIC_REFRESH_MS);
+         std::unique_lock<std::mutex> lock(mutex_);
+
+         while (!stop_requested_.wait_for(lock, period, [this]() { return stopped_; }))
+            report(false);
+      });
+   }
+
+   ~progress_reporter()
+   {
+      stop();
+   }
+
+   // Stops the reporting thread and prints the final state of counters.
+   void stop()
+   {
+      if (!thread_.joinable()) return;
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+         stopped_ = true;
+      }
+      stop_requested_.notify_all();
+      thread_.join();
+      report(true);
+   }
+};
+
+#endif /* PROGRESS_HPP_ */
@@ -0,0 +1,199 @@
+/*
+ * residency.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: simonenkos
+ */
+
+#ifndef RESIDENCY_HPP_
+#define RESIDENCY_HPP_
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <deque>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "block_order.hpp"
+#include "mapped_file.hpp"
+
+namespace
+{
+
+// Part of a file which residency is sampled at once.
+constexpr uint64_t RESIDENCY_WINDOW = 64 * 1024 * 1024;
+// Limit of data of cold blocks which readahead has been requested for, but which haven't been read yet.
+constexpr uint64_t RESIDENCY_COLD_AHEAD = 256 * 1024 * 1024;
+// Number of cold blocks checked for being brought in by readahead before the first of them is read.
+constexpr size_t RESIDENCY_PROBES = 8;
+// Blocks are given at most this far past the oldest cold block, which hasn't been read yet, since
+// results of all blocks after it wait in memory to be written till it's hashed.
+constexpr uint64_t RESIDENCY_REORDER_DISTANCE = 1024 * 1024 * 1024;
+
+}
+
+/**
+ * Order of reading blocks of a file, in which blocks found in the page cache go first.
+ * The file is mapped only to sample residency of its pages with mincore(), it's read with
+ * pread(). Blocks of a window, which are all in the cache, are given right away, and an
+ * asynchronous readahead is requested for the rest of them. Further windows are sampled
+ * for cached blocks till readahead of cold ones reaches a limit; only then cold blocks are
+ * read in order, taking the ones readahead has already brought in first. Nothing is given
+ * further than a reorder distance past the oldest cold block, it's read first instead.
+ */
+class residency_order : public block_order
+{
+   mapped_file map_;
+   uint64_t window_blocks_;
+   uint64_t reorder_blocks_;
+   size_t page_size_;
+
+   // First block after the sampled part of the file, and blocks sampled, but not read yet.
+   uint64_t sampled_end_;
+   std::deque<uint64_t> cached_;
+   std::deque<uint64_t> cold_;
+   std::vector<unsigned char> pages_;
+
+   uint64_t cached_count_;
+   uint64_t cold_count_;
+   uint64_t capped_count_;
+
+   // Checks whether a block is within the reorder distance from the oldest cold block.
+   bool within_reorder_distance(uint64_t block) const
+   {
+      return cold_.empty() || block < cold_.front() + reorder_blocks_;
+   }
+
+   // Checks residency of all pages of blocks [first, last), puts them to the cached or cold ones.
+   void sample(uint64_t first, uint64_t last)
+   {
+      uint64_t begin = first * block_size_;
+      uint64_t end   = std::min(size_, last * block_size_);
+      uint64_t page_begin = begin / page_size_ * page_size_;
+
+      pages_.resize((end - page_begin + page_size_ - 1) / page_size_);
+
+      // Without residency information, all blocks are considered cold and read in order.
+      bool known = end > begin && mincore(const_cast<uint8_t *>(map_.data()) + page_begin, end - page_begin, pages_.data()) == 0;
+      uint64_t cold_begin = 0, cold_end = 0;
+
+      for (uint64_t block = first; block < last; block++)
+      {
+         uint64_t block_begin = block * block_size_;
+         uint64_t block_end   = std::min(size_, block_begin + block_size_);
+         bool cached = end == begin;
+
+         if (known)
+         {
+            cached = true;
+            for (uint64_t page = (block_begin - page_begin) / page_size_; cached && page * page_size_ + page_begin < block_end; page++)
+               cached = pages_[page] & 1;
+         }
+
+         if (cached)
+         {
+            cached_.push_back(block);
+            continue;
+         }
+         cold_.push_back(block);
+
+         // Readahead is requested for runs of consecutive cold blocks.
+         if (cold_end != block_begin)
+         {
+            if (cold_end != cold_begin) posix_fadvise(fd_, cold_begin, cold_end - cold_begin, POSIX_FADV_WILLNEED);
+            cold_begin = block_begin;
+         }
+         cold_end = block_end;
+      }
+      if (cold_end != cold_begin) posix_fadvise(fd_, cold_begin, cold_end - cold_begin, POSIX_FADV_WILLNEED);
+   }
+
+   bool resident(uint64_t block)
+   {
+      uint64_t begin = block * block_size_;
+      uint64_t end   = std::min(size_, begin + block_size_);
+      uint64_t page_begin = begin / page_size_ * page_size_;
+
+      if (end == begin) return true;
+
+      pages_.resize((end - page_begin + page_size_ - 1) / page_size_);
+      if (mincore(const_cast<uint8_t *>(map_.data()) + page_begin, end - page_begin, pages_.data()) != 0)
+         return false;
+
+      return std::all_of(pages_.begin(), pages_.end(), [](unsigned char page) { return page & 1; });
+   }
+
+   bool prepare(const std::string & name) override
+   {
+      // Pages aren't touched through the mapping, so it doesn't need readahead of its own.
+      if (!map_.open(name, MADV_RANDOM)) return false;
+
+      window_blocks_  = std::max<uint64_t>(1, RESIDENCY_WINDOW / block_size_);
+      reorder_blocks_ = std::max<uint64_t>(1, RESIDENCY_REORDER_DISTANCE / block_size_);
+      page_size_ = sysconf(_SC_PAGESIZE);
+      return true;
+   }
+
+public:
+   residency_order() : window_blocks_(0), reorder_blocks_(0), page_size_(4096), sampled_end_(0), cached_count_(0),
+      cold_count_(0), capped_count_(0)
+   { }
+
+   // Reports numbers of blocks which have been found in the page cache and which haven't,
+   // and the reorder distance with the number of times it has been reached.
+   void report(pipeline_stats & stats) const override
+   {
+      stats.cached_blocks  = cached_count_;
+      stats.cold_blocks    = cold_count_;
+      stats.reorder_limit  = reorder_blocks_;
+      stats.reorder_capped = capped_count_;
+   }
+
+   uint64_t next_block() override
+   {
+      const size_t cold_ahead = std::max<uint64_t>(1, RESIDENCY_COLD_AHEAD / block_size_);
+
+      while (cached_.empty() && sampled_end_ < block_count_ && cold_.size() < cold_ahead &&
+             within_reorder_distance(sampled_end_))
+      {
+         uint64_t last = std::min(block_count_, sampled_end_ + window_blocks_);
+
+         sample(sampled_end_, last);
+         sampled_end_ = last;
+      }
+
+      uint64_t block;
+
+      if (!cached_.empty() && !within_reorder_distance(cached_.front()))
+         capped_count_++;
+      else if (!cached_.empty())
+      {
+         block = cached_.front();
+         cached_.pop_front();
+         cached_count_++;
+         return block;
+      }
+
+      cold_count_++;
+
+      // Blocks which readahead has already brought in go before the ones still being read.
+      for (size_t probe = 0; probe < std::min(RESIDENCY_PROBES, cold_.size()); probe++)
+      {
+         if (within_reorder_distance(cold_[probe]) && resident(cold_[probe]))
+         {
+            block = cold_[probe];
+            cold_.erase(cold_.begin() + probe);
+            return block;
+         }
+      }
+
+      block = cold_.front();
+      cold_.pop_front();
+      return block;
+   }
+};
+
+#endif /* RESIDENCY_HPP_ */
@@ -0,0 +1,291 @@
+/*
+ * scheduler.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: simonenkos
+ */
+
+#ifndef SCHEDULER_HPP_
+#define SCHEDULER_HPP_
+
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+
+#include <thool/thread_pool.hpp>
+
+#include "stats.hpp"
+
+namespace
+{
+
+// Number of recent task latencies a median is taken of, and how many of them
+// are needed before speculation starts.
+constexpr size_t SCHEDULER_LATENCY_WINDOW  = 64;
+constexpr size_t SCHEDULER_LATENCY_SAMPLES = 16;
+
+}
+
+/**
+ * Scheduler of hashing work which always runs work of the lowest block id first.
+ * Output is written in order of blocks, so a block hashed ahead of an earlier one
+ * has to wait in memory for it; a pool which takes tasks in order of submission
+ * lets such blocks pile up while the earliest one waits in the queue.
+ *
+ * Work is kept in a heap here and every submission adds a task to the pool which
+ * runs the lowest work at the moment it's started, whichever task it is.
+ *
+ * Optionally the scheduler speculates: if work of the lowest running block takes
+ * longer than a factor of the median latency, for example because its thread has been
+ * descheduled, and there is no other work for the pool, the work is run once more by
+ * an idle thread. Work is given a claim function, which returns true to the first run
+ * only, so just one of them publishes results.
+ *
+ * The number of pool tasks running work at once may be limited, leaving the rest
+ * of pool threads idle; the limit is changed at runtime by the autoscaler.
+ */
+class ordered_scheduler
+{
+public:
+   // Work gets a flag of a speculative run and a claim function.
+   using claim_function = std::function<bool()>;
+   using work_function  = std::function<void(bool, const claim_function &)>;
+
+private:
+   using clock = std::chrono::steady_clock;
+
+   struct work_item
+   {
+      uint64_t id;
+      work_function work;
+
+      bool operator>(const work_item & other) const
+      {
+         return id > other.id;
+      }
+   };
+
+   struct running_work
+   {
+      work_function work;
+      clock::time_point start;
+      std::shared_ptr<std::atomic<bool>> claimed;
+      bool speculated;
+   };
+
+   thool::thread_pool & pool_;
+   pipeline_stats & stats_;
+   double speculation_factor_;
+
+   std::mutex mutex_;
+   std::condition_variable speculation_done_;
+   std::vector<work_item> heap_;
+   std::map<uint64_t, running_work> running_;
+   uint64_t speculations_running_;
+
+   // Limit of pool tasks taking work, number of such tasks which haven't finished
+   // and number of them which haven't taken work yet.
+   size_t worker_limit_;
+   size_t workers_;
+   size_t unassigned_;
+   std::condition_variable work_taken_;
+   // Total time of running work in nanoseconds.
+   std::atomic<uint64_t> busy_time_;
+
+   clock::duration latencies_[SCHEDULER_LATENCY_WINDOW];
+   size_t latency_count_;
+   clock::duration median_latency_;
+
+   claim_function make_claim(std::shared_ptr<std::atomic<bool>> claimed, clock::time_point start, bool speculative)
+   {
+      return [this, claimed, start, speculative]()
+      {
+         bool expected = false;
+
+         if (!claimed->compare_exchange_strong(expected, true)) return false;
+
+         stats_.result_latency.add(clock::now() - start);
+         if (speculative) stats_.speculation_wins++;
+         return true;
+      };
+   }
+
+   void add_latency(clock::duration latency)
+   {
+      latencies_[latency_count_++ % SCHEDULER_LATENCY_WINDOW] = latency;
+
+      size_t samples = std::min(latency_count_, SCHEDULER_LATENCY_WINDOW);
+
+      if (samples >= SCHEDULER_LATENCY_SAMPLES)
+      {
+         clock::duration window[SCHEDULER_LATENCY_WINDOW];
+
+         std::copy(latencies_, latencies_ + samples, window);
+         std::nth_element(window, window + samples / 2, window + samples);
+         median_latency_ = window[samples / 2];
+      }
+   }
+
+   // Adds pool tasks for work which has none yet, as many as the limit of workers allows.
+   void dispatch()
+   {
+      size_t tasks;
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+
+         size_t free_workers = worker_limit_ > workers_ ? worker_limit_ - workers_ : 0;
+
+         tasks = std::min(heap_.size() - unassigned_, free_workers);
+         workers_    += tasks;
+         unassigned_ += tasks;
+      }
+
+      while (tasks-- != 0)
+      {
+         pool_.add_task
+         (
+               std::make_shared<thool::task>([this]() { run_lowest(); }, 0)
+         );
+      }
+   }
+
+   void run_lowest()
+   {
+      work_item item;
+      auto claimed = std::make_shared<std::atomic<bool>>(false);
+      auto start = clock::now();
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+
+         std::pop_heap(heap_.begin(), heap_.end(), std::greater<work_item>());
+         item = std::move(heap_.back());
+         heap_.pop_back();
+         unassigned_--;
+
+         if (speculation_factor_ > 0)
+            running_.insert({ item.id, running_work { item.work, start, claimed, false } });
+      }
+      work_taken_.notify_all();
+
+      item.work(false, make_claim(claimed, start, false));
+
+      auto latency = clock::now() - start;
+      stats_.task_latency.add(latency);
+      busy_time_ += std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count();
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+
+         workers_--;
+         if (speculation_factor_ > 0)
+         {
+            running_.erase(item.id);
+            add_latency(latency);
+         }
+      }
+      dispatch();
+   }
+
+public:
+   // Speculation is disabled with a factor of 0.
+   ordered_scheduler(thool::thread_pool & pool, pipeline_stats & stats, double speculation_factor = 0)
+      : pool_(pool), stats_(stats), speculation_factor_(speculation_factor), speculations_running_(0),
+        worker_limit_(std::numeric_limits<size_t>::max()), workers_(0), unassigned_(0), busy_time_(0),
+        latency_count_(0), median_latency_(clock::duration::zero())
+   { }
+
+   // Adds work for blocks starting with a given id.
+   void submit(uint64_t id, work_function work)
+   {
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+
+         heap_.push_back({ id, std::move(work) });
+         std::push_heap(heap_.begin(), heap_.end(), std::greater<work_item>());
+      }
+      dispatch();
+   }
+
+   // Limits the number of pool tasks running work at once. A lower limit takes effect
+   // as running work is finished.
+   void set_worker_limit(size_t limit)
+   {
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+         worker_limit_ = std::max<size_t>(1, limit);
+      }
+      dispatch();
+   }
+
+   // Number of submitted works which haven't been started yet.
+   size_t queued()
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return heap_.size();
+   }
+
+   // Waits till less than a given number of works is queued.
+   void wait_queued_below(size_t count)
+   {
+      std::unique_lock<std::mutex> lock(mutex_);
+      work_taken_.wait(lock, [this, count]() { return heap_.size() < count; });
+   }
+
+   // Total time spent running work by all workers.
+   std::chrono::nanoseconds busy_time() const
+   {
+      return std::chrono::nanoseconds(busy_time_.load());
+   }
+
+   // Starts a speculative run of work of the lowest running block if it's late. Called
+   // periodically by the reader; a run is started only when the pool has nothing else to do.
+   void speculate()
+   {
+      if (speculation_factor_ <= 0) return;
+
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      if (!heap_.empty() || running_.empty() || median_latency_ == clock::duration::zero())
+         return;
+
+      auto & head = running_.begin()->second;
+      auto now = clock::now();
+
+      if (head.speculated || now - head.start < speculation_factor_ * median_latency_)
+         return;
+
+      head.speculated = true;
+      speculations_running_++;
+      stats_.speculations++;
+
+      auto work  = head.work;
+      auto claim = make_claim(head.claimed, head.start, true);
+
+      pool_.add_task
+      (
+            std::make_shared<thool::task>([this, work, claim]()
+            {
+               work(true, claim);
+
+               std::lock_guard<std::mutex> lock(mutex_);
+               speculations_running_--;
+               speculation_done_.notify_all();
+            }, 0)
+      );
+   }
+
+   // Waits for speculative runs, which may outlive the original ones.
+   void wait_speculations()
+   {
+      std::unique_lock<std::mutex> lock(mutex_);
+      speculation_done_.wait(lock, [this]() { return speculations_running_ == 0; });
+   }
+};
+
+#endif /* SCHEDULER_HPP_ */
@@ -0,0 +1,377 @@
+/*
+ * sha256.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: simonenkos
+ */
+
+#ifndef SHA256_HPP_
+#define SHA256_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace
+{
+
+constexpr size_t SHA256_BLOCK_SIZE  = 64;
+constexpr size_t SHA256_DIGEST_SIZE = 32;
+
+// Number of messages hashed at once by the multi-buffer kernel.
+constexpr size_t SHA256_LANES = 8;
+
+const uint32_t SHA256_K[64] =
+{
+   0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+   0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+   0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+   0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+   0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+   0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+   0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+   0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+const uint32_t SHA256_INITIAL_STATE[8] =
+{
+   0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+}
+
+inline uint32_t sha256_load_be(const uint8_t * data)
+{
+   return (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16) | (uint32_t(data[2]) << 8) | data[3];
+}
+
+inline uint32_t sha256_rotr(uint32_t x, int n)
+{
+   return (x >> n) | (x << (32 - n));
+}
+
+/**
+ * Portable compression of a number of consecutive 64 byte blocks.
+ */
+inline void sha256_compress_scalar(uint32_t * state, const uint8_t * data, size_t blocks)
+{
+   for (; blocks != 0; blocks--, data += SHA256_BLOCK_SIZE)
+   {
+      uint32_t w[64];
+
+      for (int t = 0; t < 16; t++)
+         w[t] = sha256_load_be(data + 4 * t);
+
+      for (int t = 16; t < 64; t++)
+      {
+         uint32_t s0 = sha256_rotr(w[t - 15], 7) ^ sha256_rotr(w[t - 15], 18) ^ (w[t - 15] >> 3);
+         uint32_t s1 = sha256_rotr(w[t - 2], 17) ^ sha256_rotr(w[t - 2], 19)  ^ (w[t - 2] >> 10);
+         w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+      }
+
+      uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+      uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+      for (int t = 0; t < 64; t++)
+      {
+         uint32_t t1 = h + (sha256_rotr(e, 6) ^ sha256_rotr(e, 11) ^ sha256_rotr(e, 25)) + ((e & f) ^ (~e & g)) + SHA256_K[t] + w[t];
+         uint32_t t2 = (sha256_rotr(a, 2) ^ sha256_rotr(a, 13) ^ sha256_rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+
+         h = g; g = f; f = e; e = d + t1;
+         d = c; c = b; b = a; a = t1 + t2;
+      }
+
+      state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+      state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+   }
+}
+
+#if defined(__x86_64__)
+
+/**
+ * Compression with SHA extensions: each sha256rnds2 instruction does two rounds,
+ * message schedule is computed by sha256msg1/sha256msg2 four words at a time.
+ */
+__attribute__((target("sha,sse4.1")))
+inline void sha256_compress_shani(uint32_t * state, const uint8_t * data, size_t blocks)
+{
+   const __m128i byte_swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+   // Rearrange the state to the ABEF/CDGH layout used by the instructions.
+   __m128i tmp    = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(state)), 0xB1);
+   __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(state + 4)), 0x1B);
+   __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+   state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+   for (; blocks != 0; blocks--, data += SHA256_BLOCK_SIZE)
+   {
+      const __m128i abef = state0;
+      const __m128i cdgh = state1;
+      __m128i w[4];
+
+#pragma GCC unroll 16
+      for (int i = 0; i < 16; i++)
+      {
+         if (i < 4)
+         {
+            w[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 16 * i)), byte_swap);
+         }
+         else
+         {
+            __m128i next = _mm_add_epi32(_mm_sha256msg1_epu32(w[i % 4], w[(i + 1) % 4]),
+                                         _mm_alignr_epi8(w[(i + 3) % 4], w[(i + 2) % 4], 4));
+            w[i % 4] = _mm_sha256msg2_epu32(next, w[(i + 3) % 4]);
+         }
+
+         __m128i message = _mm_add_epi32(w[i % 4], _mm_loadu_si128(reinterpret_cast<const __m128i *>(SHA256_K + 4 * i)));
+         state1 = _mm_sha256rnds2_epu32(state1, state0, message);
+         state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(message, 0x0E));
+      }
+
+      state0 = _mm_add_epi32(state0, abef);
+      state1 = _mm_add_epi32(state1, cdgh);
+   }
+
+   tmp    = _mm_shuffle_epi32(state0, 0x1B);
+   state1 = _mm_shuffle_epi32(state1, 0xB1);
+   _mm_storeu_si128(reinterpret_cast<__m128i *>(state),     _mm_blend_epi16(tmp, state1, 0xF0));
+   _mm_storeu_si128(reinterpret_cast<__m128i *>(state + 4), _mm_alignr_epi8(state1, tmp, 8));
+}
+
+__attribute__((target("avx2")))
+inline __m256i sha256_rotr8x(__m256i x, int n)
+{
+   return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+}
+
+/**
+ * Transposes 8 rows of 8 words, so that word i of all rows gets into row i.
+ */
+__attribute__((target("avx2")))
+inline void sha256_transpose8x8(__m256i * rows)
+{
+   __m256i t[8], u[8];
+
+   for (int i = 0; i < 8; i += 2)
+   {
+      t[i]     = _mm256_unpacklo_epi32(rows[i], rows[i + 1]);
+      t[i + 1] = _mm256_unpackhi_epi32(rows[i], rows[i + 1]);
+   }
+   for (int i = 0; i < 8; i += 4)
+   {
+      u[i]     = _mm256_unpacklo_epi64(t[i],     t[i + 2]);
+      u[i + 1] = _mm256_unpackhi_epi64(t[i],     t[i + 2]);
+      u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+      u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+   }
+   for (int i = 0; i < 4; i++)
+   {
+      rows[i]     = _mm256_permute2x128_si256(u[i], u[i + 4], 0x20);
+      rows[i + 4] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x31);
+   }
+}
+
+/**
+ * Multi-buffer compression with AVX2: each 32 bit lane of a vector holds a word
+ * of a different message, so blocks of 8 messages are compressed at once.
+ * States are stored lane by lane, state[8 * lane + word].
+ */
+__attribute__((target("avx2")))
+inline void sha256_compress_avx2x8(uint32_t * state, const uint8_t * const * data, size_t blocks)
+{
+   const __m256i byte_swap = _mm256_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL,
+                                               0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+   __m256i s[8];
+
+   for (int i = 0; i < 8; i++)
+      s[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(state + 8 * i));
+   sha256_transpose8x8(s);
+
+   for (size_t block = 0; block < blocks; block++)
+   {
+      __m256i w[16];
+
+      for (int half = 0; half < 2; half++)
+      {
+         for (size_t lane = 0; lane < SHA256_LANES; lane++)
+         {
+            const uint8_t * words = data[lane] + block * SHA256_BLOCK_SIZE + 32 * half;
+            w[8 * half + lane] = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(words)), byte_swap);
+         }
+         sha256_transpose8x8(w + 8 * half);
+      }
+
+      __m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+
+      for (int t = 0; t < 64; t++)
+      {
+         if (t >= 16)
+         {
+            __m256i w15 = w[(t - 15) & 15], w2 = w[(t - 2) & 15];
+            __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(sha256_rotr8x(w15, 7), sha256_rotr8x(w15, 18)), _mm256_srli_epi32(w15, 3));
+            __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(sha256_rotr8x(w2, 17), sha256_rotr8x(w2, 19)),  _mm256_srli_epi32(w2, 10));
+            w[t & 15] = _mm256_add_epi32(_mm256_add_epi32(w[t & 15], s0), _mm256_add_epi32(w[(t - 7) & 15], s1));
+         }
+
+         __m256i sigma1 = _mm256_xor_si256(_mm256_xor_si256(sha256_rotr8x(e, 6), sha256_rotr8x(e, 11)), sha256_rotr8x(e, 25));
+         __m256i choice = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+         __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, sigma1),
+                                       _mm256_add_epi32(_mm256_add_epi32(choice, _mm256_set1_epi32(SHA256_K[t])), w[t & 15]));
+         __m256i sigma0   = _mm256_xor_si256(_mm256_xor_si256(sha256_rotr8x(a, 2), sha256_rotr8x(a, 13)), sha256_rotr8x(a, 22));
+         __m256i majority = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+         __m256i t2 = _mm256_add_epi32(sigma0, majority);
+
+         h = g; g = f; f = e; e = _mm256_add_epi32(d, t1);
+         d = c; c = b; b = a; a = _mm256_add_epi32(t1, t2);
+      }
+
+      s[0] = _mm256_add_epi32(s[0], a); s[1] = _mm256_add_epi32(s[1], b);
+      s[2] = _mm256_add_epi32(s[2], c); s[3] = _mm256_add_epi32(s[3], d);
+      s[4] = _mm256_add_epi32(s[4], e); s[5] = _mm256_add_epi32(s[5], f);
+      s[6] = _mm256_add_epi32(s[6], g); s[7] = _mm256_add_epi32(s[7], h);
+   }
+
+   sha256_transpose8x8(s);
+   for (int i = 0; i < 8; i++)
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(state + 8 * i), s[i]);
+}
+
+inline bool sha256_shani_supported()
+{
+   static const bool supported = __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1");
+   return supported;
+}
+
+inline bool sha256_avx2_supported()
+{
+   static const bool supported = __builtin_cpu_supports("avx2");
+   return supported;
+}
+
+#endif
+
+using sha256_compress_function = void (*)(uint32_t *, const uint8_t *, size_t);
+
+/**
+ * Gets the fastest compression function for a single message.
+ */
+inline sha256_compress_function sha256_compress()
+{
+#if defined(__x86_64__)
+   if (sha256_shani_supported()) return sha256_compress_shani;
+#endif
+   return sha256_compress_scalar;
+}
+
+/**
+ * Finishes hashing of a message, which first full blocks have been compressed into
+ * a state already, by compressing the rest of them and padding. Writes the digest.
+ */
+inline void sha256_finish(uint32_t * state, const uint8_t * rest, size_t rest_size, uint64_t total_size,
+                          uint8_t * digest, sha256_compress_function compress)
+{
+   size_t full_blocks = rest_size / SHA256_BLOCK_SIZE;
+   compress(state, rest, full_blocks);
+   rest += full_blocks * SHA256_BLOCK_SIZE;
+   rest_size -= full_blocks * SHA256_BLOCK_SIZE;
+
+   // Padding: a one bit, zeros and a message length in bits, in one or two blocks.
+   uint8_t tail[2 * SHA256_BLOCK_SIZE] = {};
+   size_t tail_size = (rest_size < SHA256_BLOCK_SIZE - 8) ? SHA256_BLOCK_SIZE : 2 * SHA256_BLOCK_SIZE;
+   uint64_t bits = total_size * 8;
+
+   std::memcpy(tail, rest, rest_size);
+   tail[rest_size] = 0x80;
+   for (int i = 0; i < 8; i++)
+      tail[tail_size - 1 - i] = static_cast<uint8_t>(bits >> (8 * i));
+
+   compress(state, tail, tail_size / SHA256_BLOCK_SIZE);
+
+   for (int i = 0; i < 8; i++)
+   {
+      digest[4 * i]     = state[i] >> 24;
+      digest[4 * i + 1] = state[i] >> 16;
+      digest[4 * i + 2] = state[i] >> 8;
+      digest[4 * i + 3] = state[i];
+   }
+}
+
+/**
+ * Calculates SHA-256 digest of a single message.
+ */
+inline void sha256(const uint8_t * data, size_t size, uint8_t * digest, sha256_compress_function compress = sha256_compress())
+{
+   uint32_t state[8];
+
+   std::memcpy(state, SHA256_INITIAL_STATE, sizeof(state));
+   sha256_finish(state, data, size, size, digest, compress);
+}
+
+#if defined(__x86_64__)
+
+/**
+ * Calculates SHA-256 digests of count messages by groups of 8, which are compressed
+ * at once with AVX2 for as many blocks as all of them have; the rest of each message
+ * is finished alone.
+ */
+inline void sha256_messages_avx2x8(const uint8_t * const * data, const size_t * sizes, size_t count, uint8_t * digests)
+{
+   for (; count != 0; )
+   {
+      size_t lanes = std::min(count, SHA256_LANES);
+      const uint8_t * lane_data[SHA256_LANES];
+      size_t common_blocks = sizes[0] / SHA256_BLOCK_SIZE;
+
+      // Lanes without a message just repeat the first one.
+      for (size_t lane = 0; lane < SHA256_LANES; lane++)
+      {
+         lane_data[lane] = data[lane < lanes ? lane : 0];
+         common_blocks = std::min(common_blocks, sizes[lane < lanes ? lane : 0] / SHA256_BLOCK_SIZE);
+      }
+
+      uint32_t states[8 * SHA256_LANES];
+
+      for (size_t lane = 0; lane < SHA256_LANES; lane++)
+         std::memcpy(states + 8 * lane, SHA256_INITIAL_STATE, sizeof(SHA256_INITIAL_STATE));
+
+      sha256_compress_avx2x8(states, lane_data, common_blocks);
+
+      size_t common_size = common_blocks * SHA256_BLOCK_SIZE;
+
+      for (size_t lane = 0; lane < lanes; lane++)
+         sha256_finish(states + 8 * lane, data[lane] + common_size, sizes[lane] - common_size, sizes[lane],
+                       digests + lane * SHA256_DIGEST_SIZE, sha256_compress_scalar);
+
+      data += lanes; sizes += lanes; digests += lanes * SHA256_DIGEST_SIZE; count -= lanes;
+   }
+}
+
+#endif
+
+/**
+ * Calculates SHA-256 digests of count messages, each digest takes SHA256_DIGEST_SIZE
+ * bytes of digests. SHA extensions are the fastest way to hash a message if they're
+ * supported, otherwise messages are hashed by groups of 8 with AVX2.
+ */
+inline void sha256_messages(const uint8_t * const * data, const size_t * sizes, size_t count, uint8_t * digests)
+{
+#if defined(__x86_64__)
+   if (!sha256_shani_supported() && sha256_avx2_supported())
+   {
+      sha256_messages_avx2x8(data, sizes, count, digests);
+      return;
+   }
+#endif
+
+   sha256_compress_function compress = sha256_compress();
+
+   for (size_t i = 0; i < count; i++)
+      sha256(data[i], sizes[i], digests + i * SHA256_DIGEST_SIZE, compress);
+}
+
+#endif /* SHA256_HPP_ */
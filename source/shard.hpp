@@ -0,0 +1,304 @@
+/*
+ * shard.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: simonenkos
+ */
+
+#ifndef SHARD_HPP_
+#define SHARD_HPP_
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <boost/any.hpp>
+#include <boost/regex.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/program_options.hpp>
+
+#include "mapped_file.hpp"
+#include "output_format.hpp"
+#include "sha256.hpp"
+#include "sigdiff.hpp"
+
+/**
+ * Shard of blocks of an input, signed by a process of its own: index from 0 and the number of shards.
+ */
+struct shard_spec
+{
+   unsigned index;
+   unsigned count;
+};
+
+/**
+ * Overload function for validation of shard_spec values needed for boost::program_options.
+ * A shard is given as <index>/<count>.
+ */
+inline void validate(boost::any & value, const std::vector<std::string> & string_values, shard_spec * target_type, int)
+{
+   namespace bpo = boost::program_options;
+   static const boost::regex r("^(\\d+)/(\\d+)$");
+
+   bpo::validators::check_first_occurrence(value);
+   boost::smatch match;
+
+   if (regex_match(bpo::validators::get_single_string(string_values), match, r))
+   {
+      shard_spec shard;
+
+      try
+      {
+         shard.index = boost::lexical_cast<unsigned>(match[1]);
+         shard.count = boost::lexical_cast<unsigned>(match[2]);
+      }
+      catch (boost::bad_lexical_cast & e)
+      {
+         throw bpo::validation_error
+         (
+               bpo::validation_error::invalid_option_value
+         );
+      }
+
+      // Shards are counted by 16 bits of the header.
+      if (shard.index < shard.count && shard.count <= std::numeric_limits<uint16_t>::max())
+      {
+         value = boost::any(shard);
+         return;
+      }
+   }
+   throw bpo::validation_error
+   (
+         bpo::validation_error::invalid_option_value
+   );
+}
+
+/**
+ * Finds a range [first, end) of blocks of a shard. Shards are consecutive ranges of blocks,
+ * so each process reads a part of the input sequentially, and a merge just concatenates
+ * them. Sizes of shards differ at most by a block, the first ones are larger.
+ */
+inline void shard_blocks(uint64_t block_count, unsigned index, unsigned count, uint64_t & first, uint64_t & end)
+{
+   uint64_t size = block_count / count, rest = block_count % count;
+
+   first = index * size + std::min<uint64_t>(index, rest);
+   end   = first + size + (index < rest ? 1 : 0);
+}
+
+/**
+ * Identity of a state of an input, which shards of it are signed from: its device and inode,
+ * or the device it is, and its modification time, so shards of another file or of the same
+ * file modified between them aren't merged. Returns 0 if the input can't be found.
+ */
+inline uint64_t input_identity(const std::string & name)
+{
+   struct stat st;
+
+   if (stat(name.c_str(), &st) != 0) return 0;
+
+   const uint64_t fields[] = { static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino),
+                               static_cast<uint64_t>(st.st_rdev), static_cast<uint64_t>(st.st_mtim.tv_sec),
+                               static_cast<uint64_t>(st.st_mtim.tv_nsec) };
+   uint8_t digest[SHA256_DIGEST_SIZE];
+   uint64_t id;
+
+   sha256(reinterpret_cast<const uint8_t *>(fields), sizeof(fields), digest);
+   std::memcpy(&id, digest, sizeof(id));
+   return id;
+}
+
+/**
+ * Checks whether two names are of the same file.
+ */
+inline bool same_file(const std::string & first_name, const std::string & second_name)
+{
+   struct stat first, second;
+
+   return stat(first_name.c_str(), &first) == 0 && stat(second_name.c_str(), &second) == 0 &&
+          first.st_dev == second.st_dev && first.st_ino == second.st_ino;
+}
+
+/**
+ * Merges shards of the sig format into a signature of the whole input. Shards may be given
+ * in any order; they must be complete, of the same state of the input, algorithm and block size, and
+ * all of them must be there with the ranges of blocks they are expected to have. Shards
+ * are mapped and their digests are copied to the mapped output one after another, so
+ * a merge takes as long as copying of the signature does. Returns an exit status.
+ */
+inline int merge_signatures(const std::vector<std::string> & names, const std::string & output_name)
+{
+   std::vector<mapped_file> files(names.size());
+   std::vector<signature_header> headers(names.size());
+   std::string error;
+
+   for (size_t i = 0; i < names.size(); i++)
+   {
+      if (!(error = open_signature(names[i], files[i], headers[i])).empty())
+      {
+         std::cerr << error << std::endl;
+         return EXIT_FAILURE;
+      }
+      if (!(headers[i].flags & SIGNATURE_SHARD) || !(headers[i].flags & SIGNATURE_COMPLETE))
+      {
+         std::cerr << names[i] << ": not a complete shard of a signature" << std::endl;
+         return EXIT_FAILURE;
+      }
+      if (same_file(names[i], output_name))
+      {
+         std::cerr << names[i] << ": shard is same as output file" << std::endl;
+         return EXIT_FAILURE;
+      }
+   }
+
+   const signature_header & first = headers.front();
+
+   if (first.shard_count != names.size())
+   {
+      std::cerr << "signature has " << first.shard_count << " shards, " << names.size() << " are given" << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   const uint64_t block_count = std::max<uint64_t>(1, (first.input_size + first.block_size - 1) / first.block_size);
+   std::vector<size_t> shards(first.shard_count, names.size());
+
+   for (size_t i = 0; i < names.size(); i++)
+   {
+      const signature_header & header = headers[i];
+      uint64_t begin, end;
+
+      if (header.algorithm != first.algorithm || header.block_size != first.block_size ||
+          header.shard_count != first.shard_count || header.input_size != first.input_size ||
+          header.input_id != first.input_id || header.shard_index >= header.shard_count)
+      {
+         std::cerr << names[i] << ": shard is of another signature than " << names.front() << std::endl;
+         return EXIT_FAILURE;
+      }
+      if (shards[header.shard_index] != names.size())
+      {
+         std::cerr << names[i] << ": shard " << header.shard_index << " is given twice" << std::endl;
+         return EXIT_FAILURE;
+      }
+      shards[header.shard_index] = i;
+
+      // Each shard covers exactly its range of blocks and the bytes of the input within it.
+      shard_blocks(block_count, header.shard_index, header.shard_count, begin, end);
+
+      if (header.block_count != end - begin ||
+          header.covered_size != std::min(end * header.block_size, header.input_size) -
+                                 std::min(begin * header.block_size, header.input_size))
+      {
+         std::cerr << names[i] << ": shard doesn't cover blocks " << begin << "-" << end << " of the input" << std::endl;
+         return EXIT_FAILURE;
+      }
+   }
+
+   const size_t size = sizeof(signature_header) + block_count * first.digest_size;
+   int fd = ::open(output_name.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+   if (fd == -1 || ftruncate(fd, size) != 0)
+   {
+      std::cerr << "can't open output file: " << std::strerror(errno) << std::endl;
+      if (fd != -1) ::close(fd);
+      return EXIT_FAILURE;
+   }
+
+   void * data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+   if (data == MAP_FAILED)
+   {
+      std::cerr << "can't map output file: " << std::strerror(errno) << std::endl;
+      ::close(fd);
+      return EXIT_FAILURE;
+   }
+
+   uint8_t * output = static_cast<uint8_t *>(data);
+   uint8_t * position = output + sizeof(signature_header);
+
+   for (size_t shard : shards)
+   {
+      size_t length = headers[shard].block_count * first.digest_size;
+
+      std::memcpy(position, files[shard].data() + sizeof(signature_header), length);
+      position += length;
+   }
+
+   // The header is the last, it's the one of a whole signature.
+   signature_header header = first;
+
+   header.block_count  = block_count;
+   header.covered_size = first.input_size;
+   header.flags        = SIGNATURE_COMPLETE;
+   header.shard_index  = 0;
+   header.shard_count  = 0;
+   header.input_id     = 0;
+   header.input_size   = 0;
+   std::memcpy(output, &header, sizeof(header));
+
+   bool written = munmap(data, size) == 0;
+
+   written = ::close(fd) == 0 && written;
+   if (!written)
+   {
+      std::cerr << "can't write output file: " << std::strerror(errno) << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   std::cout << names.size() << " shards of " << block_count << " blocks are merged" << std::endl;
+   return EXIT_SUCCESS;
+}
+
+/**
+ * Entry point of the merge subcommand: merge -o <output> <shard>...
+ */
+inline int merge_main(int argc, char ** argv)
+{
+   namespace bpo = boost::program_options;
+
+   std::vector<std::string> names;
+   std::string output_name;
+   bpo::options_description desc("usage: signature merge -o <output> <shard>...");
+   bpo::positional_options_description positional;
+   bpo::variables_map vm;
+
+   desc.add_options()
+         ("help,h", "print help")
+         ("output,o", bpo::value<std::string>(&output_name)->required(), "signature file of the whole input")
+         ("shards", bpo::value<std::vector<std::string>>(&names), "shards of the sig format, in any order");
+   positional.add("shards", -1);
+
+   try
+   {
+      bpo::store(bpo::command_line_parser(argc, argv).options(desc).positional(positional).run(), vm);
+
+      if (vm.count("help"))
+      {
+         std::cout << desc << std::endl;
+         return EXIT_SUCCESS;
+      }
+
+      bpo::notify(vm);
+
+      if (names.empty())
+         throw std::logic_error("merge requires shard files");
+   }
+   catch (std::exception & e)
+   {
+      std::cerr << e.what() << std::endl;
+      std::cout << desc << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   return merge_signatures(names, output_name);
+}
+
+#endif /* SHARD_HPP_ */
@@ -0,0 +1,361 @@
+/*
+ * sigdiff.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: simonenkos
+ */
+
+#ifndef SIGDIFF_HPP_
+#define SIGDIFF_HPP_
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include <boost/program_options.hpp>
+
+#include <thool/thread_pool.hpp>
+
+#include "compare.hpp"
+#include "digest.hpp"
+#include "mapped_file.hpp"
+#include "output_format.hpp"
+
+namespace
+{
+
+// Amount of digests compared by a single task.
+constexpr uint64_t SIGDIFF_TASK_SIZE = 64 * 1024 * 1024;
+
+}
+
+/**
+ * Range of consecutive blocks.
+ */
+struct block_range
+{
+   uint64_t first;
+   uint64_t count;
+};
+
+/**
+ * Adds a block to a list of ranges, extending the last range if the block follows it.
+ * Blocks are added in order, a digest may be found different by parts several times.
+ */
+inline void add_block(std::vector<block_range> & ranges, uint64_t block)
+{
+   if (!ranges.empty() && ranges.back().first + ranges.back().count > block)
+      return;
+   if (!ranges.empty() && ranges.back().first + ranges.back().count == block)
+      ranges.back().count++;
+   else
+      ranges.push_back({ block, 1 });
+}
+
+/**
+ * Adds blocks, which bytes differ in a mask, to ranges. Bit i of the mask stands for byte
+ * position + i of digests; the rest of a differing digest is skipped at once.
+ */
+inline void add_different_blocks(std::vector<block_range> & ranges, uint64_t mask, uint64_t position, size_t digest_size)
+{
+   while (mask != 0)
+   {
+      uint64_t offset = position + __builtin_ctzll(mask);
+      uint64_t block  = offset / digest_size;
+      uint64_t next   = (block + 1) * digest_size - position;
+
+      add_block(ranges, block);
+      mask = (next >= 64) ? 0 : mask & ~((uint64_t(1) << next) - 1);
+   }
+}
+
+/**
+ * Finds blocks in [first, last) which digests differ, comparing 8 bytes at once.
+ */
+inline void diff_digests_generic(const uint8_t * a, const uint8_t * b, size_t digest_size, uint64_t first, uint64_t last,
+                                 std::vector<block_range> & ranges)
+{
+   uint64_t position = first * digest_size, end = last * digest_size;
+
+   for (; position + 8 <= end; position += 8)
+   {
+      uint64_t x, y;
+
+      std::memcpy(&x, a + position, sizeof(x));
+      std::memcpy(&y, b + position, sizeof(y));
+
+      if (x != y)
+      {
+         uint64_t mask = 0;
+
+         for (int i = 0; i < 8; i++)
+            if (a[position + i] != b[position + i]) mask |= uint64_t(1) << i;
+         add_different_blocks(ranges, mask, position, digest_size);
+      }
+   }
+
+   for (; position < end; position++)
+   {
+      if (a[position] != b[position]) add_block(ranges, position / digest_size);
+   }
+}
+
+#if defined(__x86_64__)
+
+/**
+ * Finds blocks in [first, last) which digests differ, comparing 64 bytes at once with AVX2.
+ * Equal parts cost two loads and a compare per 32 bytes; masks of differing bytes are
+ * built only where digests differ.
+ */
+__attribute__((target("avx2")))
+inline void diff_digests_avx2(const uint8_t * a, const uint8_t * b, size_t digest_size, uint64_t first, uint64_t last,
+                              std::vector<block_range> & ranges)
+{
+   uint64_t position = first * digest_size, end = last * digest_size;
+
+   for (; position + 64 <= end; position += 64)
+   {
+      __m256i x0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + position));
+      __m256i y0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + position));
+      __m256i x1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + position + 32));
+      __m256i y1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + position + 32));
+
+      __m256i difference = _mm256_or_si256(_mm256_xor_si256(x0, y0), _mm256_xor_si256(x1, y1));
+
+      if (_mm256_testz_si256(difference, difference)) continue;
+
+      uint64_t equal = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x0, y0))) |
+                       (uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x1, y1)))) << 32);
+
+      add_different_blocks(ranges, ~equal, position, digest_size);
+   }
+
+   // The tail, shorter than 64 bytes, which may start in the middle of a digest.
+   for (; position < end; position++)
+   {
+      if (a[position] != b[position]) add_block(ranges, position / digest_size);
+   }
+}
+
+#endif
+
+inline void diff_digests(const uint8_t * a, const uint8_t * b, size_t digest_size, uint64_t first, uint64_t last,
+                         std::vector<block_range> & ranges)
+{
+#if defined(__x86_64__)
+   static const bool avx2 = __builtin_cpu_supports("avx2");
+
+   if (avx2)
+   {
+      diff_digests_avx2(a, b, digest_size, first, last, ranges);
+      return;
+   }
+#endif
+   diff_digests_generic(a, b, digest_size, first, last, ranges);
+}
+
+/**
+ * Maps a signature file of the sig format and checks its header.
+ * Returns an empty string or a description of a problem.
+ */
+inline std::string open_signature(const std::string & name, mapped_file & file, signature_header & header)
+{
+   if (!file.open(name, MADV_SEQUENTIAL))
+      return name + ": " + std::strerror(errno);
+
+   if (file.size() < sizeof(header))
+      return name + ": not a signature file";
+
+   std::memcpy(&header, file.data(), sizeof(header));
+
+   if (std::memcmp(header.magic, SIGNATURE_MAGIC, sizeof(header.magic)) != 0)
+      return name + ": not a signature file";
+   if (header.version != SIGNATURE_VERSION)
+      return name + ": unsupported version of a signature file";
+   if (header.digest_size == 0 || header.digest_size > DIGEST_MAX_SIZE ||
+       header.digest_size != digest_size(static_cast<hash_algorithm>(header.algorithm)))
+      return name + ": unsupported algorithm of a signature file";
+   if (header.block_size == 0)
+      return name + ": not a signature file";
+   if ((file.size() - sizeof(header)) / header.digest_size < header.block_count)
+      return name + ": signature file is truncated";
+
+   if (header.flags & SIGNATURE_PARTIAL)
+      std::cerr << name << ": signature is partial, it covers " << header.block_count << " blocks" << std::endl;
+   else if (!(header.flags & SIGNATURE_COMPLETE))
+      std::cerr << name << ": signature wasn't finished, it covers " << header.block_count << " blocks" << std::endl;
+
+   return std::string();
+}
+
+/**
+ * Compares two signature files of the sig format and prints ranges of blocks which
+ * differ, one per line: "<first block>-<last block> <offset> <length>". Blocks are
+ * compared by parts in parallel on the thread pool. Blocks which are covered by only one
+ * of signatures differ too. Returns one of COMPARE_* exit codes.
+ */
+inline int diff_signatures(const std::string & first_name, const std::string & second_name)
+{
+   mapped_file first_file, second_file;
+   signature_header first, second;
+   std::string error;
+
+   if (!(error = open_signature(first_name,  first_file,  first)).empty() ||
+       !(error = open_signature(second_name, second_file, second)).empty())
+   {
+      std::cerr << error << std::endl;
+      return COMPARE_TROUBLE;
+   }
+
+   if ((first.flags | second.flags) & SIGNATURE_SHARD)
+   {
+      std::cerr << "shards of a signature have to be merged to be compared" << std::endl;
+      return COMPARE_TROUBLE;
+   }
+   if (first.algorithm != second.algorithm || first.block_size != second.block_size)
+   {
+      std::cerr << "signatures are incompatible: they differ in algorithm or block size" << std::endl;
+      return COMPARE_TROUBLE;
+   }
+
+   const uint8_t * first_digests  = first_file.data()  + sizeof(signature_header);
+   const uint8_t * second_digests = second_file.data() + sizeof(signature_header);
+   const size_t digest_size = first.digest_size;
+   const uint64_t common_blocks = std::min(first.block_count, second.block_count);
+   const uint64_t blocks_per_task = std::max<uint64_t>(1, SIGDIFF_TASK_SIZE / digest_size);
+   const uint64_t task_count = (common_blocks + blocks_per_task - 1) / blocks_per_task;
+
+   // Each task finds ranges in its own part, they are joined in order afterwards.
+   std::vector<std::vector<block_range>> parts(task_count);
+   compare_state state;
+
+   auto & tp = thool::thread_pool::instance();
+
+   for (uint64_t task = 0; task < task_count; task++)
+   {
+      uint64_t begin = task * blocks_per_task;
+      uint64_t end   = std::min(common_blocks, begin + blocks_per_task);
+
+      state.active_tasks++;
+      tp.add_task
+      (
+            std::make_shared<thool::task>([&, task, begin, end]()
+            {
+               diff_digests(first_digests, second_digests, digest_size, begin, end, parts[task]);
+
+               std::lock_guard<std::mutex> lock(state.mutex);
+               state.active_tasks--;
+               state.task_done.notify_all();
+            }, 0)
+      );
+   }
+
+   {
+      // Wait for all comparison tasks to be finished.
+      std::unique_lock<std::mutex> lock(state.mutex);
+      state.task_done.wait(lock, [&state]()
+      {
+         return state.active_tasks.load() == 0;
+      });
+   }
+   tp.stop();
+
+   std::vector<block_range> ranges;
+
+   for (const auto & part : parts)
+   {
+      for (const auto & range : part)
+      {
+         if (!ranges.empty() && ranges.back().first + ranges.back().count == range.first)
+            ranges.back().count += range.count;
+         else
+            ranges.push_back(range);
+      }
+   }
+
+   // Blocks beyond the end of a shorter signature differ as well.
+   uint64_t total_blocks = std::max(first.block_count, second.block_count);
+
+   if (total_blocks != common_blocks)
+   {
+      if (!ranges.empty() && ranges.back().first + ranges.back().count == common_blocks)
+         ranges.back().count += total_blocks - common_blocks;
+      else
+         ranges.push_back({ common_blocks, total_blocks - common_blocks });
+   }
+
+   uint64_t covered_size = std::max(first.covered_size, second.covered_size);
+   uint64_t different_blocks = 0;
+
+   for (const auto & range : ranges)
+   {
+      uint64_t offset = range.first * first.block_size;
+      uint64_t end    = std::min(covered_size, (range.first + range.count) * first.block_size);
+
+      std::printf("%llu-%llu %llu %llu\n",
+                  static_cast<unsigned long long>(range.first), static_cast<unsigned long long>(range.first + range.count - 1),
+                  static_cast<unsigned long long>(offset), static_cast<unsigned long long>(end > offset ? end - offset : 0));
+      different_blocks += range.count;
+   }
+
+   std::fflush(stdout);
+   std::cerr << different_blocks << " of " << total_blocks << " blocks differ in " << ranges.size() << " ranges" << std::endl;
+
+   return ranges.empty() ? COMPARE_EQUAL : COMPARE_DIFFERENT;
+}
+
+/**
+ * Entry point of the sigdiff subcommand: sigdiff <first.sig> <second.sig>.
+ */
+inline int sigdiff_main(int argc, char ** argv)
+{
+   namespace bpo = boost::program_options;
+
+   std::vector<std::string> names;
+   bpo::options_description desc("usage: signature sigdiff <first signature> <second signature>");
+   bpo::positional_options_description positional;
+   bpo::variables_map vm;
+
+   desc.add_options()
+         ("help,h", "print help")
+         ("signatures", bpo::value<std::vector<std::string>>(&names), "signature files of the sig format");
+   positional.add("signatures", -1);
+
+   try
+   {
+      bpo::store(bpo::command_line_parser(argc, argv).options(desc).positional(positional).run(), vm);
+
+      if (vm.count("help"))
+      {
+         std::cout << desc << std::endl;
+         return COMPARE_EQUAL;
+      }
+
+      bpo::notify(vm);
+
+      if (names.size() != 2)
+         throw std::logic_error("sigdiff requires exactly two signature files");
+   }
+   catch (std::exception & e)
+   {
+      std::cerr << e.what() << std::endl;
+      std::cout << desc << std::endl;
+      return COMPARE_TROUBLE;
+   }
+
+   return diff_signatures(names[0], names[1]);
+}
+
+#endif /* SIGDIFF_HPP_ */
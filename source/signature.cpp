@@ -15,10 +15,34 @@
 
 #include <boost/regex.hpp>
 #include <boost/program_options.hpp>
-#include <boost/crc.hpp>
 
 #include <thool/thread_pool.hpp>
 
+#include "append.hpp"
+#include "autoscale.hpp"
+#include "benchmark.hpp"
+#include "block_device.hpp"
+#include "cancellation.hpp"
+#include "cgroup.hpp"
+#include "decompress.hpp"
+#include "compare.hpp"
+#include "copy.hpp"
+#include "digest.hpp"
+#include "extent_cache.hpp"
+#include "extents.hpp"
+#include "file_io.hpp"
+#include "output_format.hpp"
+#include "progress.hpp"
+#include "residency.hpp"
+#include "scheduler.hpp"
+#include "shard.hpp"
+#include "sigdiff.hpp"
+#include "small_input.hpp"
+#include "stats.hpp"
+#include "tar.hpp"
+#include "throttle.hpp"
+#include "xattr_cache.hpp"
+
 namespace bpo = boost::program_options;
 
 namespace
@@ -89,6 +113,16 @@ public:
    }
 };
 
+/**
+ * Block of an input file which has been read, but not hashed yet.
+ */
+struct read_block
+{
+   std::shared_ptr<block_buffer> buffer;
+   uint64_t size;
+   uint64_t id;
+};
+
 /**
  * Overload function for validation of block_size class objects needed for boost::program_options.
  */
@@ -136,10 +170,27 @@ void validate(boost::any & value, const std::vector<std::string> & string_values
 
 int main(int argc, char ** argv)
 {
+   // Subcommands have options of their own.
+   if (argc > 1 && std::string(argv[1]) == "sigdiff")
+      return sigdiff_main(argc - 1, argv + 1);
+   if (argc > 1 && std::string(argv[1]) == "merge")
+      return merge_main(argc - 1, argv + 1);
+
    // Set default block size.
    block_size block_size_value { BLOCK_SIZE_MEGABYTE };
+   // Set default output format.
+   output_format output_format_value { output_format::raw };
+   // Set default hashing algorithm.
+   hash_algorithm hash_algorithm_value { hash_algorithm::crc32 };
 
-   std::string input_file_name, output_file_name;
+   std::string input_file_name, output_file_name, copy_file_name, extent_cache_name, append_from_name;
+   std::vector<std::string> compare_file_names;
+   data_rate max_read_rate { 0 };
+   unsigned max_cpu_percent = 0;
+   double speculation_factor = 0;
+   scaling_range workers_range { 0, 0 }, read_ahead_range { 0, 0 };
+   shard_spec shard { 0, 0 };
+   std::string io_priority;
    bpo::options_description help_desc, main_desc, desc;
    bpo::variables_map vm;
 
@@ -147,9 +198,34 @@ int main(int argc, char ** argv)
    help_desc.add_options()
          ("help,h", "print help");
    main_desc.add_options()
-         ("input,i",  bpo::value<std::string>(&input_file_name)->required(),   "input file")
-         ("output,o", bpo::value<std::string>(&output_file_name)->required(),  "output file to store input file's signature")
-         ("block,b",  bpo::value<block_size> (&block_size_value),              "size of a processing block in bytes (1K, 1M, 1G)");
+         ("input,i",  bpo::value<std::string>(&input_file_name),               "input file, - for the standard input")
+         ("output,o", bpo::value<std::string>(&output_file_name),              "output file to store input file's signature")
+         ("block,b",  bpo::value<block_size> (&block_size_value),              "size of a processing block in bytes (1K, 1M, 1G)")
+         ("format,f", bpo::value<output_format>(&output_format_value),         "format of the output file (raw, sig, hex, jsonl, sum); raw ends with a digest of an empty block if the input is a multiple of the block size, as it always has")
+         ("algorithm,a", bpo::value<hash_algorithm>(&hash_algorithm_value),    "digest of each block (crc32, sha256, blake3)")
+         ("copy-to",  bpo::value<std::string>(&copy_file_name),                "copy input file to a destination while signing it")
+         ("copy-direct",                                                       "write the copy with direct I/O, bypassing the page cache")
+         ("decompress,d",                                                      "sign decompressed content of a gzip or zstd input file")
+         ("tar",                                                               "sign each member of a tar archive, writing an index of signatures to <output>.index")
+         ("cached-first",                                                      "hash blocks found in the page cache first, reading the rest with readahead")
+         ("physical-order",                                                    "read blocks in order of their physical offsets on storage (FIEMAP), for fragmented files")
+         ("extent-cache",    bpo::value<std::string>(&extent_cache_name),     "reuse digests of blocks sharing extents with files signed before (reflinks, snapshots), kept in a cache file")
+         ("append-from",     bpo::value<std::string>(&append_from_name),      "continue a signature of the sig format of an input which has grown since, hashing appended blocks only")
+         ("follow",                                                            "keep running after signing, appending blocks to the signature as the input grows (inotify)")
+         ("shard",           bpo::value<shard_spec>(&shard),                   "sign only shard <i>/<N> (from 0) of consecutive blocks into a partial signature of the sig format, for the merge subcommand")
+         ("xattr-cache",                                                       "keep the signature in an extended attribute of the input file (digests of large files in a hidden file next to it), taking it from there while the file is unchanged; a write with mtime restored at once while it's stored isn't noticed")
+         ("speculate",       bpo::value<double>(&speculation_factor),          "hash a head block again if it takes longer than this factor of the median time (e.g. 4), counted against --max-cpu-percent too")
+         ("workers",         bpo::value<scaling_range>(&workers_range),       "number of hashing workers, or a range <min>-<max> scaled between I/O- and CPU-bound")
+         ("read-ahead",      bpo::value<scaling_range>(&read_ahead_range),    "number of blocks read ahead of hashing, or a range <min>-<max> scaled likewise")
+         ("stats",                                                             "print statistics of the pipeline to stderr at the end")
+         ("progress",                                                          "report progress of processing to stderr")
+         ("max-read-rate",   bpo::value<data_rate>(&max_read_rate),            "limit of input reading bandwidth per second (e.g. 50M)")
+         ("max-cpu-percent", bpo::value<unsigned>(&max_cpu_percent),           "limit of CPU usage of each hashing thread in percents (1-100)")
+         ("ioprio",          bpo::value<std::string>(&io_priority),            "I/O scheduling class (idle, best-effort[:0-7])")
+         ("adaptive",                                                          "back off while the system is under I/O or CPU pressure (Linux PSI)")
+         ("benchmark",                                                         "measure throughput of hashing kernels for the block size")
+         ("compare",  bpo::value<std::vector<std::string>>(&compare_file_names)->multitoken(),
+                                                                               "compare two files block by block instead of signing (exit status: 0 - equal, 1 - different, 2 - trouble)");
    desc.add(help_desc).add(main_desc);
 
    try
@@ -160,10 +236,34 @@ int main(int argc, char ** argv)
       if (vm.count("help") || (argc == 1))
       {
          std::cout << desc << std::endl;
+         std::cout << "subcommands:" << std::endl;
+         std::cout << "  sigdiff <first.sig> <second.sig>  print ranges of blocks which differ in two signatures" << std::endl;
+         std::cout << "  merge -o <output> <shard>...      merge shards signed with --shard into a signature of the whole input" << std::endl;
          return EXIT_SUCCESS;
       }
 
       bpo::notify(vm);
+
+      // Input and output files are required only for signing.
+      if (vm.count("compare"))
+      {
+         if (compare_file_names.size() != 2)
+            throw std::logic_error("the option '--compare' requires exactly two files");
+      }
+      else if (!vm.count("benchmark"))
+      {
+         for (const char * option : { "input", "output" })
+         {
+            if (!vm.count(option))
+               throw bpo::required_option(std::string("--") + option);
+         }
+      }
+
+      if (vm.count("max-cpu-percent") && (max_cpu_percent == 0 || max_cpu_percent > 100))
+         throw bpo::validation_error(bpo::validation_error::invalid_option_value, "--max-cpu-percent");
+
+      if (vm.count("speculate") && speculation_factor < 1)
+         throw bpo::validation_error(bpo::validation_error::invalid_option_value, "--speculate");
    }
    catch (std::exception & e)
    {
@@ -172,27 +272,141 @@ int main(int argc, char ** argv)
       return EXIT_FAILURE;
    }
 
+   if (vm.count("benchmark"))
+      return run_benchmark(block_size_value.get()) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+   if (vm.count("compare"))
+      return compare_files(compare_file_names[0], compare_file_names[1], block_size_value.get());
+
    // Check application arguments for special cases and limitations.
    if (input_file_name == output_file_name)
    {
       std::cerr << "input and output files are same" << std::endl;
       return EXIT_FAILURE;
    }
+   if (!copy_file_name.empty() && (copy_file_name == input_file_name || copy_file_name == output_file_name))
+   {
+      std::cerr << "copy file is same as input or output file" << std::endl;
+      return EXIT_FAILURE;
+   }
+   // Members of an archive are numbered from zero each, so they have no place in a copy.
+   const bool tar_mode = vm.count("tar");
+
+   if (tar_mode && !copy_file_name.empty())
+   {
+      std::cerr << "archive can't be copied while its members are signed" << std::endl;
+      return EXIT_FAILURE;
+   }
+   // Blocks are read out of order only from a regular file, which is signed as is.
+   const bool cached_first = vm.count("cached-first");
+   const bool extent_caching = !extent_cache_name.empty();
+   const bool physical_order = vm.count("physical-order") || extent_caching;
+
+   if ((cached_first || physical_order) &&
+       (input_file_name == "-" || tar_mode || vm.count("decompress") || is_block_device(input_file_name)))
+   {
+      std::cerr << "only a regular file can be read out of order" << std::endl;
+      return EXIT_FAILURE;
+   }
+   if (cached_first && physical_order)
+   {
+      std::cerr << "blocks can be read either cached first or in physical order, as the extent cache does" << std::endl;
+      return EXIT_FAILURE;
+   }
+   // Signature of a regular file only is kept in its attributes, the one of its own content.
+   const bool xattr_cache = vm.count("xattr-cache");
+
+   if (xattr_cache && (input_file_name == "-" || tar_mode || vm.count("decompress") || is_block_device(input_file_name)))
+   {
+      std::cerr << "signature can be kept in attributes of a regular file only" << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   // Signature of a growing input is continued from its last full block, which is read
+   // in order from there. It's of the sig format, which tells where it ends.
+   const bool appending = !append_from_name.empty();
+   const bool follow = vm.count("follow");
+   append_point point {};
+
+   if ((appending || follow) &&
+       (input_file_name == "-" || tar_mode || vm.count("decompress") || is_block_device(input_file_name) ||
+        cached_first || physical_order || xattr_cache || !copy_file_name.empty()))
+   {
+      std::cerr << "only a signature of a regular file read in order can be appended to" << std::endl;
+      return EXIT_FAILURE;
+   }
+   if ((appending || follow) && vm.count("format") && output_format_value != output_format::sig)
+   {
+      std::cerr << "only a signature of the sig format can be appended to" << std::endl;
+      return EXIT_FAILURE;
+   }
+   if (appending || follow) output_format_value = output_format::sig;
+
+   // Shard is a range of blocks of the whole input, which is known before reading.
+   const bool sharded = vm.count("shard");
+
+   if (sharded &&
+       (input_file_name == "-" || tar_mode || vm.count("decompress") || cached_first || physical_order || xattr_cache ||
+        appending || follow || !copy_file_name.empty()))
+   {
+      std::cerr << "only a regular file or a block device read in order can be signed by shards" << std::endl;
+      return EXIT_FAILURE;
+   }
+   if (sharded && vm.count("format") && output_format_value != output_format::sig)
+   {
+      std::cerr << "shards are signatures of the sig format" << std::endl;
+      return EXIT_FAILURE;
+   }
+   if (sharded) output_format_value = output_format::sig;
+
+   if (appending)
+   {
+      std::string error = find_append_point(append_from_name, input_file_name, point);
+
+      if (!error.empty())
+      {
+         std::cerr << "can't append to signature: " << error << std::endl;
+         return EXIT_FAILURE;
+      }
+      if ((vm.count("block") && block_size_value.get() != point.block_size) ||
+          (vm.count("algorithm") && hash_algorithm_value != point.algorithm))
+      {
+         std::cerr << "block size and algorithm differ from the ones of the signature appended to" << std::endl;
+         return EXIT_FAILURE;
+      }
+      block_size_value = block_size { point.block_size };
+      hash_algorithm_value = point.algorithm;
+   }
 
    // Print information about processing details.
    std::cout << "input  file = " << input_file_name        << std::endl;
    std::cout << "output file = " << output_file_name       << std::endl;
    std::cout << "block  size = " << block_size_value.get() << std::endl;
+   std::cout << "algorithm   = " << hash_algorithm_name(hash_algorithm_value) << std::endl;
+   if (!copy_file_name.empty())
+      std::cout << "copy   file = " << copy_file_name      << std::endl;
 
-   std::ifstream input_file { input_file_name, std::ios::binary };
+   // Input "-" is the standard input, which is read sequentially only.
+   const bool standard_input = input_file_name == "-";
+   std::ifstream input_file;
 
-   if (!input_file.is_open())
+   if (!standard_input)
    {
-      std::cerr << "can't open input file" << std::endl;
-      return EXIT_FAILURE;
+      input_file.open(input_file_name, std::ios::binary);
+
+      if (!input_file.is_open())
+      {
+         std::cerr << "can't open input file" << std::endl;
+         return EXIT_FAILURE;
+      }
    }
 
-   std::ofstream output_file_stream { output_file_name, std::ios::binary | std::ios::trunc };
+   std::istream & input_stream = standard_input ? std::cin : input_file;
+
+   std::ofstream output_file_stream;
+
+   if (appending) open_append_output(append_from_name, output_file_name, point, output_file_stream);
+   else output_file_stream.open(output_file_name, std::ios::binary | std::ios::trunc);
 
    if (!output_file_stream.is_open())
    {
@@ -200,52 +414,565 @@ int main(int argc, char ** argv)
       return EXIT_FAILURE;
    }
 
-   uint64_t block_counter = 0;
-   uint64_t last_processed_block_id = 0;
+   // Signature which is kept in attributes of the input is written as is, unless the input
+   // has to be read anyway to be copied. Otherwise the state of the input is taken before
+   // it's read, so its signature is stored only if the input hasn't changed meanwhile.
+   xattr_signature_cache signature_cache { input_file_name, hash_algorithm_value, block_size_value.get() };
+   std::vector<block_result> signed_results;
+
+   if (xattr_cache)
+   {
+      if (copy_file_name.empty() && signature_cache.load(signed_results))
+      {
+         signature_writer cached_writer { output_file_stream, output_format_value, hash_algorithm_value,
+                                          block_size_value.get(), input_file_name };
+
+         cached_writer.begin();
+         cached_writer.write(signed_results);
+         cached_writer.finish(true);
+         output_file_stream.flush();
+
+         if (!output_file_stream.good())
+         {
+            std::cerr << "can't write output file" << std::endl;
+            return EXIT_FAILURE;
+         }
+
+         std::cout << "signature is taken from attributes of input file" << std::endl;
+         std::cout << "done" << std::endl;
+         return EXIT_SUCCESS;
+      }
+      signature_cache.begin();
+   }
+
+   // Lambda which stores a signature of the input which has been completed to its attributes.
+   // It's not an error if the signature can't be stored, only a later run has to read the input again.
+   auto signature_storer = [&]()
+   {
+      std::string error;
+
+      if (!signature_cache.store(signed_results, error))
+         std::cerr << "signature isn't kept in attributes of input file: " << error << std::endl;
+   };
+
+   // Options which tune reading and hashing, or change the order of blocks, apply to the pipeline only.
+   const bool pipeline_tuned = cached_first || physical_order || vm.count("ioprio") || vm.count("max-read-rate") ||
+                               vm.count("max-cpu-percent") || vm.count("adaptive") || vm.count("workers") ||
+                               vm.count("read-ahead") || vm.count("speculate");
+
+   // A small file is signed right away on this thread, the thread pool isn't even created.
+   if (!standard_input && !tar_mode && !vm.count("decompress") && copy_file_name.empty() && !appending && !follow && !sharded &&
+       !vm.count("stats") && !vm.count("progress") && !pipeline_tuned && is_small_input(input_file_name, block_size_value.get()))
+   {
+      std::string error = sign_small_input(input_file_name, output_file_stream, output_format_value, hash_algorithm_value,
+                                           block_size_value.get(), xattr_cache ? &signed_results : nullptr);
+
+      if (!error.empty())
+      {
+         std::cerr << error << std::endl;
+         return EXIT_FAILURE;
+      }
+      if (xattr_cache) signature_storer();
+
+      std::cout << "done" << std::endl;
+      return EXIT_SUCCESS;
+   }
+
+   std::ofstream index_file_stream;
+
+   if (tar_mode)
+   {
+      index_file_stream.open(output_file_name + ".index", std::ios::binary | std::ios::trunc);
+
+      if (!index_file_stream.is_open())
+      {
+         std::cerr << "can't open index file" << std::endl;
+         return EXIT_FAILURE;
+      }
+   }
+
+   // Each block is written to the copy by the task which hashes it.
+   copy_target copy;
+
+   if (!copy_file_name.empty())
+   {
+      if (!copy.open(copy_file_name, block_size_value.get(), vm.count("copy-direct")))
+      {
+         std::cerr << "can't open copy file: " << std::strerror(errno) << std::endl;
+         return EXIT_FAILURE;
+      }
+      if (vm.count("copy-direct") && !copy.direct())
+         std::cerr << "direct I/O isn't available for the copy, it's written through the page cache" << std::endl;
+   }
+
+   // Set I/O priority before the thread pool is created, so its threads inherit it.
+   if (!io_priority.empty() && !set_io_priority(io_priority))
+   {
+      std::cerr << "can't set I/O priority " << io_priority << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   throttle limits { max_read_rate.bytes_per_second, max_cpu_percent };
+
+   if (vm.count("adaptive") && !limits.adapt_to_pressure())
+      std::cerr << "pressure stall information is not available, adaptation is disabled" << std::endl;
+
+   // Compressed input is read through a decompressor, which runs ahead of the reading cycle.
+   std::unique_ptr<decompressor> decompressed;
+
+   if (vm.count("decompress"))
+   {
+      try
+      {
+         decompressed = open_decompressor(standard_input ? "/dev/stdin" : input_file_name, thool::thread_pool::instance());
+      }
+      catch (const std::exception & err)
+      {
+         std::cerr << err.what() << std::endl;
+         return EXIT_FAILURE;
+      }
+   }
+
+   // Blocks kept of a signature appended to aren't read again.
+   uint64_t block_counter = point.blocks;
+   uint64_t last_processed_block_id = point.blocks;
 
    // Map of crc of blocks ordered by block number.
-   std::map <uint64_t, uint32_t> block_crc_map;
+   std::map <uint64_t, block_result> block_crc_map;
    // Mutex for map that will be accessed through several threads.
    std::mutex block_crc_map_mutex;
+   // Id of the first block which hasn't been hashed yet, all results of blocks after it are out of order.
+   uint64_t hashed_frontier = point.blocks;
+
+   signature_writer writer { output_file_stream, output_format_value, hash_algorithm_value, block_size_value.get(), input_file_name };
+   std::vector<block_result> crc_batch;
+
+   // Reads size bytes of input data, less of them only at its end.
+   auto read_input = [&decompressed, &input_stream, standard_input](char * data, size_t size) -> size_t
+   {
+      if (decompressed) return decompressed->read(data, size);
+      // The standard input is read by its descriptor, so cancellation interrupts a read waiting for data.
+      if (standard_input) return read_stream(STDIN_FILENO, data, size);
+
+      input_stream.read(data, size);
+      return input_stream.gcount();
+   };
+
+   // Order of blocks of the input by their residency in the page cache or by their places on storage.
+   // A block device, which isn't a file of a file system, is read by an order of its own.
+   std::unique_ptr<block_order> order;
+   device_order * device = nullptr;
+   extent_order * extents = nullptr;
+
+   if (cached_first) order.reset(new residency_order);
+   else if (physical_order) order.reset(extents = new extent_order);
+   else if (!tar_mode && !decompressed && is_block_device(input_file_name)) order.reset(device = new device_order);
+
+   if (order && !order->open(input_file_name, block_size_value.get()))
+   {
+      std::cerr << "can't map input file: " << std::strerror(errno) << std::endl;
+      return EXIT_FAILURE;
+   }
+   if (extents && !extents->mapped())
+      std::cerr << "layout of the input file isn't available, it's read in logical order" << std::endl;
+   if (device)
+   {
+      const device_geometry & geometry = device->geometry();
+
+      std::cout << "device     = " << geometry.size << " bytes, sectors " << geometry.logical_sector << "/"
+                << geometry.physical_sector << ", optimal I/O " << geometry.optimal_io << ", queue depth "
+                << device->queue_depth() << (device->direct() ? ", direct I/O" : "")
+                << (geometry.discard ? ", discard" : "") << std::endl;
+   }
+
+   // Blocks of a shard are read from its first block till its end only.
+   uint64_t shard_end = std::numeric_limits<uint64_t>::max();
+
+   if (sharded)
+   {
+      uint64_t input_size = order ? order->size() : 0;
+
+      if (!order && !stream_size(input_file, input_size))
+      {
+         std::cerr << "size of input file is unknown, it can't be signed by shards" << std::endl;
+         return EXIT_FAILURE;
+      }
+
+      shard_blocks(std::max<uint64_t>(1, (input_size + block_size_value.get() - 1) / block_size_value.get()),
+                   shard.index, shard.count, block_counter, shard_end);
+      last_processed_block_id = hashed_frontier = block_counter;
+
+      if (order) order->limit(block_counter, shard_end);
+      writer.shard(shard.index, shard.count, input_identity(input_file_name), input_size);
+
+      std::cout << "shard       = " << shard.index << "/" << shard.count << ", first block " << block_counter << ", "
+                << shard_end - block_counter << " blocks" << std::endl;
+   }
+
+   // Digests of blocks by their physical places, which are kept between runs. The input is
+   // a source of digests for later runs, its path is absolute to be found from anywhere.
+   extent_cache cache;
+   size_t cache_source_index = 0;
+   struct stat input_stat;
+   std::string input_filesystem;
+
+   if (extents && extent_caching)
+   {
+      char * path = realpath(input_file_name.c_str(), nullptr);
+
+      if (!cache.load(extent_cache_name))
+         std::cerr << "extent cache file is corrupted, it's started anew" << std::endl;
+      if (path == nullptr || stat(path, &input_stat) != 0 || (input_filesystem = filesystem_id(path)).empty())
+      {
+         std::cerr << "can't stat input file: " << std::strerror(errno) << std::endl;
+         std::free(path);
+         return EXIT_FAILURE;
+      }
+      cache_source_index = cache.add_source(cache_source::of(path, input_stat));
+      std::free(path);
+   }
+
+   // Blocks of members of an archive are numbered one after another as blocks of a single file,
+   // the writer of the archive splits them back to signatures of members.
+   tar_reader tar { read_input };
+   tar_signature_writer tar_writer { writer, output_file_stream, index_file_stream };
+
+   // Number of tasks which are added to the thread pool, but not finished yet.
+   std::atomic<uint64_t> active_tasks { 0 };
+
+   progress_counters counters;
+   std::unique_ptr<progress_reporter> reporter;
+
+   if (vm.count("progress"))
+   {
+      uint64_t total = decompressed ? decompressed->size() : order ? order->size() : 0;
+
+      // Size of an input which can't seek, e.g. a named pipe, is unknown as the one of the standard input.
+      if (!decompressed && !order && !standard_input && !stream_size(input_file, total)) total = 0;
+      // Only blocks from the first one to be read till the end of a shard are counted.
+      if (sharded) total = std::min(total, shard_end * block_size_value.get());
+      reporter.reset(new progress_reporter(counters, total - std::min(total, block_counter * block_size_value.get())));
+   }
+   // Reading continues a signature appended to or starts at the first block of a shard.
+   if (!order && block_counter != 0) input_file.seekg(block_counter * block_size_value.get());
+
+   // Lambda which stores digests of consecutive blocks, which lie within single extents, to the extent cache.
+   auto digests_recorder = [&](uint64_t first_block_id, const std::vector<block_result> & batch)
+   {
+      for (size_t i = 0; i < batch.size(); i++)
+      {
+         uint64_t physical;
+
+         if (extents->physical_block(first_block_id + i, physical))
+            cache.add({ input_filesystem, physical, batch[i].length, hash_algorithm_value }, batch[i].digest, cache_source_index,
+                      (first_block_id + i) * block_size_value.get());
+      }
+   };
 
    // Lambda for output file operations such as saving a crc of a block into a file according to block id.
-   auto crc_saver = [&output_file_stream, &block_crc_map, &last_processed_block_id]()
+   // Checksums of consecutive blocks are taken out of the map under the lock and written as one batch
+   // after it's released, so formatting of the output doesn't hold up tasks.
+   auto crc_saver = [&writer, &tar_writer, tar_mode, &crc_batch, &counters, &block_crc_map, &block_crc_map_mutex,
+                     &last_processed_block_id, extents, extent_caching, &digests_recorder, xattr_cache, &signed_results]()
    {
-      while (true)
+      uint64_t batch_bytes = 0;
+
+      crc_batch.clear();
       {
-         // Search for a checksum for a current block.
-         auto block = block_crc_map.find(last_processed_block_id);
+         std::lock_guard<std::mutex> lock(block_crc_map_mutex);
 
-         if (block_crc_map.end() != block)
+         while (true)
          {
-            // If the checksum for the block has been calculated, save it
-            // to the output stream and move to a next block.
-            output_file_stream.write(reinterpret_cast<char *>(&block->second), sizeof(block->second));
-            last_processed_block_id++;
+            // Search for a checksum for a current block.
+            auto block = block_crc_map.find(last_processed_block_id);
+
+            if (block_crc_map.end() != block)
+            {
+               // If the checksum for the block has been calculated, move it
+               // to the batch and move to a next block.
+               crc_batch.push_back(block->second);
+               batch_bytes += block->second.length;
+               block_crc_map.erase(block);
+               last_processed_block_id++;
+            }
+            else break;
          }
-         else break;
       }
+      if (tar_mode) tar_writer.write(crc_batch);
+      else writer.write(crc_batch);
+      counters.blocks_saved(crc_batch.size(), batch_bytes);
+      if (extents && extent_caching) digests_recorder(last_processed_block_id - crc_batch.size(), crc_batch);
+      if (xattr_cache) signed_results.insert(signed_results.end(), crc_batch.begin(), crc_batch.end());
    };
 
+   // Choose hashing kernels of the algorithm for the block size.
+   const block_hasher hasher { hash_algorithm_value, block_size_value.get() };
+
    // Get an instance of the thread pool.
    auto & tp = thool::thread_pool::instance();
+   // Tasks hash blocks with the lowest ids first, so results wait for earlier ones as little as possible.
+   pipeline_stats stats;
+   ordered_scheduler scheduler { tp, stats, speculation_factor };
+
+   // Blocks which have been read, but not given to the thread pool yet. Some kernels
+   // are given blocks in batches, which are hashed at once by interleaving their computations.
+   const size_t blocks_per_task = hasher.blocks_per_task();
+   std::vector<read_block> pending_blocks;
+
+   // Containers see all cores and memory of the host, so defaults follow limits of the cgroup:
+   // workers don't exceed the CPU quota and blocks in flight fit into memory with a margin,
+   // before the OOM killer would have to step in.
+   const resource_limits resources = read_resource_limits();
+
+   stats.cpus = resources.cpus;
+   stats.memory_budget = resources.memory_budget;
+
+   if (!vm.count("workers"))
+      workers_range = { default_workers(resources), default_workers(resources) };
+
+   // Without a read-ahead workers which fall behind can't be noticed, so a range of workers gets one.
+   if (workers_range.scaled() && !vm.count("read-ahead"))
+      read_ahead_range = { static_cast<unsigned>(workers_range.min * blocks_per_task),
+                           static_cast<unsigned>(4 * workers_range.max * blocks_per_task) };
+
+   if (resources.memory_budget != 0 && !vm.count("read-ahead"))
+   {
+      // Blocks being hashed by workers take their share of the budget first.
+      uint64_t blocks = resources.memory_budget / block_size_value.get();
+      uint64_t hashed = uint64_t(workers_range.max) * blocks_per_task;
+      unsigned budget = static_cast<unsigned>(std::min<uint64_t>(std::numeric_limits<unsigned>::max(),
+                                                                 std::max<uint64_t>(1, blocks > hashed ? blocks - hashed : 1)));
+
+      if (read_ahead_range.max == 0)
+         read_ahead_range = { budget, budget };
+      else if (read_ahead_range.max > budget)
+         read_ahead_range = { std::min(read_ahead_range.min, budget), budget };
+   }
+
+   // Ranges of a device which have been discarded are likely read as zeros, a digest
+   // of a block of zeros is computed once for all of them.
+   std::unique_ptr<block_digest> zero_digest;
+
+   if (device && device->geometry().discard)
+   {
+      block_buffer zeros(block_size_value.get(), 0);
+      const uint8_t * data = reinterpret_cast<const uint8_t *>(zeros.data());
+      size_t size = zeros.size();
+
+      zero_digest.reset(new block_digest);
+      hasher.hash(&data, &size, 1, zero_digest.get());
+   }
+
+   // Limits of workers and of the read-ahead, adjusted to the load if they are ranges.
+   autoscaler scaling { scheduler, stats, workers_range, read_ahead_range, blocks_per_task };
+
+   // Lambda which gives pending blocks to a new task of the scheduler.
+   auto blocks_submitter = [&]()
+   {
+      if (pending_blocks.empty()) return;
+
+      uint64_t first_block_id = pending_blocks.front().id;
+
+      auto task = [blocks = std::move(pending_blocks), &block_crc_map, &block_crc_map_mutex, &limits, &active_tasks,
+                   &hasher, &copy, &stats, &last_processed_block_id, &hashed_frontier, block_size = block_size_value.get(),
+                   zero_digest = zero_digest.get()]
+                  (bool speculative, const ordered_scheduler::claim_function & claim) mutable
+      {
+         // Don't start hashing of blocks after cancellation, they won't be saved anyway.
+         if (cancel_requested())
+         {
+            if (!speculative) active_tasks--;
+            return;
+         }
+
+         const uint8_t * data[DIGEST_BATCH_SIZE];
+         size_t sizes[DIGEST_BATCH_SIZE];
+         size_t indexes[DIGEST_BATCH_SIZE];
+         block_digest hashed[DIGEST_BATCH_SIZE];
+         block_digest digests[DIGEST_BATCH_SIZE];
+         size_t count = 0;
+
+         for (size_t i = 0; i < blocks.size(); i++)
+         {
+            // Whole blocks of zeros get the digest computed once.
+            if (zero_digest && blocks[i].size == block_size && is_zero_block(blocks[i].buffer->data(), block_size))
+            {
+               digests[i] = *zero_digest;
+               if (!speculative) stats.zero_blocks++;
+               continue;
+            }
+
+            data[count]      = reinterpret_cast<const uint8_t *>(blocks[i].buffer->data());
+            sizes[count]     = blocks[i].size;
+            indexes[count++] = i;
+         }
+
+         // Write blocks to the copy first, so they are hashed right after, while still in cache.
+         // A speculative run, which hashes the same buffers again, leaves the copy to the original one.
+         if (copy.is_open() && !speculative)
+         {
+            for (const auto & block : blocks)
+               copy.write_block(block.buffer->data(), block.size, block.id * block_size);
+         }
+
+         auto hash_start = std::chrono::steady_clock::now();
+         // Calculate digests for a given data in buffers.
+         if (count != 0) hasher.hash(data, sizes, count, hashed);
+         auto hash_time = std::chrono::steady_clock::now() - hash_start;
+         for (size_t i = 0; i < count; i++)
+            digests[indexes[i]] = hashed[i];
+         // Free up memory hold by buffers, which have been both written and hashed.
+         // A speculative run holds buffers of its own till it's finished.
+         if (!speculative)
+         {
+            for (auto & block : blocks)
+               block.buffer.reset();
+         }
+
+         // Only the first of the original and a speculative run saves results.
+         if (claim())
+         {
+            while (true)
+            {
+               try
+               {
+                  std::lock_guard<std::mutex> lock(block_crc_map_mutex);
+                  // Inserting checksums of blocks into the map to keep order of blocks.
+                  for (size_t i = 0; i < blocks.size(); i++)
+                     block_crc_map.insert({ blocks[i].id, block_result { digests[i], blocks[i].size } });
+                  // Results before the frontier are in order, they just wait to be written.
+                  uint64_t distance = blocks.front().id - hashed_frontier;
+
+                  hashed_frontier = std::max(hashed_frontier, last_processed_block_id);
+                  while (block_crc_map.count(hashed_frontier) != 0) hashed_frontier++;
+
+                  stats.result_pending(distance, block_crc_map.size() - (hashed_frontier - last_processed_block_id));
+                  // Break out of the cycle.
+                  break;
+               }
+               catch (const std::bad_alloc & err)
+               {
+                  // Put task to sleep, to wait for free memory.
+                  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+               }
+            }
+         }
+         // Keep the thread within limits of CPU usage, a speculative run is hashing as well.
+         // Results are published before, so the writer doesn't wait for them while it sleeps.
+         limits.block_hashed(hash_time);
+         if (!speculative) active_tasks--;
+      };
+      pending_blocks.clear();
+
+      active_tasks++;
+      scheduler.submit(first_block_id, std::move(task));
+   };
+
+   // Blocks of the input which share extents with blocks of files signed before get their digests
+   // from the cache instead of being read. Only extents which are shared at the moment are trusted,
+   // data of others may have been moved and their places taken by something else, and only while
+   // the source of a digest still has its block in the same place.
+   if (extents && extent_caching)
+   {
+      extents->skip_blocks([&](uint64_t block) -> bool
+      {
+         uint64_t physical;
+         const file_extent * extent = extents->physical_block(block, physical);
+         block_result result;
+
+         if (extent == nullptr || !extent->shared()) return false;
+
+         result.length = std::min<uint64_t>(block_size_value.get(), extents->size() - block * block_size_value.get());
+         if (!cache.find({ input_filesystem, physical, result.length, hash_algorithm_value }, result.digest)) return false;
+
+         {
+            std::lock_guard<std::mutex> lock(block_crc_map_mutex);
+            block_crc_map.insert({ block, result });
+         }
+         counters.block_read(result.length);
+         stats.reused_blocks++;
+         block_counter++;
+         return true;
+      });
+   }
+
+   // From now on SIGINT and SIGTERM stop processing gracefully, leaving
+   // a consistent signature of blocks processed so far.
+   install_cancel_handlers();
+   if (appending)
+   {
+      writer.resume(point.blocks, point.blocks * block_size_value.get());
+
+      if (!output_file_stream.good() || !cut_signature(output_file_name, point))
+      {
+         std::cerr << "can't write output file" << std::endl;
+         return EXIT_FAILURE;
+      }
+   }
+   else if (!tar_mode) writer.begin();
+
+   bool input_end = block_counter == shard_end;
+   bool member_end = true;
 
    // Reading a data from the input stream till the end.
-   while (!input_file.eof())
+   while (!input_end && !cancel_requested() && !copy.failed())
    {
       // Create a temporary buffer to get block's data from input file.
-      std::shared_ptr<std::vector<char>> buffer_ptr;
+      std::shared_ptr<block_buffer> buffer_ptr;
       std::streamsize readed_size;
+      uint64_t block_id = block_counter;
+
+      // Don't read further ahead of hashing than allowed.
+      scaling.wait_for_room();
 
       try
       {
          // Allocate vector of size block_size and put it to a shared pointer,
          // cause it should be available for a task out of scope of the cycle.
-         buffer_ptr = std::make_shared<std::vector<char>>(block_size_value.get(), 0);
-         // Read data from input stream to buffer, which size is equal to block_size.
-         input_file.read(buffer_ptr->data(), buffer_ptr->size());
-         // Get real amount of data that was read.
-         readed_size = input_file.gcount();
+         buffer_ptr = std::make_shared<block_buffer>(block_size_value.get(), 0);
+         auto read_start = std::chrono::steady_clock::now();
+         if (tar_mode)
+         {
+            // Move to a next member after the last block of a previous one.
+            if (member_end)
+            {
+               tar_member member;
+
+               if (!tar.next(member))
+               {
+                  input_end = true;
+                  continue;
+               }
+               tar_writer.add_member(member);
+            }
+
+            // Blocks of a member end with the first incomplete one, an empty member still gets a one.
+            readed_size = tar.read(buffer_ptr->data(), buffer_ptr->size());
+            member_end = tar.remaining() == 0;
+
+            if (member_end) tar_writer.end_member(block_counter + 1);
+         }
+         else if (order)
+         {
+            // Blocks are taken out of order till the order runs out of them.
+            if (!order->next(block_id))
+            {
+               input_end = true;
+               continue;
+            }
+            readed_size = order->read(block_id, *buffer_ptr);
+         }
+         else
+         {
+            // Read data from input stream to buffer, which size is equal to block_size.
+            // Data ends with the first incomplete block.
+            readed_size = read_input(buffer_ptr->data(), buffer_ptr->size());
+            input_end = static_cast<uint64_t>(readed_size) < buffer_ptr->size() || block_id + 1 == shard_end;
+         }
+         auto read_time = std::chrono::steady_clock::now() - read_start;
+         // Keep reading within limits of bandwidth.
+         limits.block_read(readed_size, read_time);
+         scaling.block_read(read_time);
       }
       catch (const std::bad_alloc & err)
       {
@@ -254,6 +981,13 @@ int main(int argc, char ** argv)
          // And repeat current cycle.
          continue;
       }
+      catch (const std::runtime_error & err)
+      {
+         // Decompressors report corrupted input data.
+         std::cerr << "can't read input file: " << err.what() << std::endl;
+         tp.stop();
+         return EXIT_FAILURE;
+      }
       catch (const std::exception & err)
       {
          std::cerr << "unexpected exception: " << err.what() << std::endl;
@@ -261,59 +995,92 @@ int main(int argc, char ** argv)
          return EXIT_FAILURE;
       }
 
-      auto task = [buffer_ptr, readed_size, &block_crc_map, &block_crc_map_mutex, block_counter]()
-      {
-         boost::crc_32_type crc_hash;
-         // Calculate CRC32 hash for a given data in the buffer.
-         crc_hash.process_bytes(buffer_ptr->data(), readed_size);
-         // Get resulting checksum.
-         boost::crc_32_type::value_type crc_value = crc_hash.checksum();
-         // Free up memory hold by buffer.
-         buffer_ptr->clear();
-         buffer_ptr->shrink_to_fit();
+      // A read interrupted by cancellation may have an incomplete block, which isn't signed.
+      if (cancel_requested()) break;
 
-         while (true)
-         {
-            try
-            {
-               std::lock_guard<std::mutex> lock(block_crc_map_mutex);
-               // Inserting a checksum of the block into the map to keep order of blocks.
-               block_crc_map.insert({ block_counter, crc_value });
-               // Break out of the cycle.
-               break;
-            }
-            catch (const std::bad_alloc & err)
-            {
-               // Put task to sleep, to wait for free memory.
-               std::this_thread::sleep_for(std::chrono::milliseconds(10));
-            }
-         }
-      };
-      tp.add_task
-      (
-            std::make_shared<thool::task>(task, 0)
-      );
+      // Reading of a file which size is a multiple of the block size ends with
+      // an empty read, which is not a block. Empty file still gets a one.
+      if (readed_size == 0 && block_counter != 0 && !tar_mode) break;
+
+      counters.block_read(readed_size);
+
+      pending_blocks.push_back({ buffer_ptr, static_cast<uint64_t>(readed_size), block_id });
+      if (pending_blocks.size() == blocks_per_task) blocks_submitter();
       block_counter++;
 
-      std::lock_guard<std::mutex> lock(block_crc_map_mutex);
-      // Wait while map will have a number of checksums to be processed.
-      if (block_crc_map.size() >= BLOCK_CRC_MAP_PROCESSING_SIZE) crc_saver();
+      bool batch_ready;
+      {
+         std::lock_guard<std::mutex> lock(block_crc_map_mutex);
+         // Wait while map will have a number of checksums to be processed.
+         batch_ready = block_crc_map.size() >= BLOCK_CRC_MAP_PROCESSING_SIZE;
+      }
+      if (batch_ready) crc_saver();
+      // Check if the head block is late and has to be hashed once more.
+      scheduler.speculate();
    }
 
-   while (last_processed_block_id != block_counter)
+   // Give the last incomplete batch to the thread pool.
+   if (!cancel_requested() && !copy.failed()) blocks_submitter();
+
+   while (last_processed_block_id != block_counter && !cancel_requested() && !copy.failed())
    {
       // Processing remaining checksums by calling crc_saver every 10 ms
       // to be sure if some tasks are finished.
       std::this_thread::sleep_for(std::chrono::milliseconds(10));
-      std::lock_guard<std::mutex> lock(block_crc_map_mutex);
       crc_saver();
+      scheduler.speculate();
    }
+
+   // After cancellation tasks which are already hashing are let to finish, the rest
+   // of them return right away, so this wait takes at most a time of a single block.
+   while (active_tasks.load() != 0)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+   scheduler.wait_speculations();
    tp.stop();
 
-   std::cout << "done" << std::endl;
+   // Save checksums of consecutive blocks which have been processed before cancellation.
+   crc_saver();
+
+   // Signature of a copy which has failed doesn't describe it, so it's marked as partial.
+   bool copied = copy.close();
+   bool complete = last_processed_block_id == block_counter && !cancel_requested() && copied;
+   if (tar_mode) tar_writer.finish(complete);
+   else writer.finish(complete);
+
+   if (extents && extent_caching && !cache.save(extent_cache_name))
+      std::cerr << "can't save extent cache file" << std::endl;
+   if (xattr_cache && complete) signature_storer();
+
+   if (reporter) reporter->stop();
+   if (vm.count("stats"))
+   {
+      if (order) order->report(stats);
+      stats.print();
+   }
+
+   if (!copied)
+   {
+      std::cerr << "can't write copy file: " << copy.error() << std::endl;
+      return EXIT_FAILURE;
+   }
+   if (!complete)
+   {
+      std::cerr << "cancelled, signature is partial up to block " << last_processed_block_id << std::endl;
+      return cancel_exit_status();
+   }
 
    input_file.close();
    output_file_stream.close();
+   index_file_stream.close();
 
+   // A growing input is followed further, its signature is brought up to date after each write.
+   if (follow)
+   {
+      int status = follow_input(input_file_name, output_file_name);
+
+      if (status != EXIT_SUCCESS) return status;
+   }
+
+   std::cout << "done" << std::endl;
    return EXIT_SUCCESS;
 }
@@ -0,0 +1,106 @@
+/*
+ * small_input.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: simonenkos
+ */
+
+#ifndef SMALL_INPUT_HPP_
+#define SMALL_INPUT_HPP_
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ostream>
+#include <sstream>
+
+#include <sys/stat.h>
+
+#include "digest.hpp"
+#include "mapped_file.hpp"
+#include "output_format.hpp"
+
+namespace
+{
+
+// Inputs up to this size, or up to a single block, are hashed on the calling thread.
+constexpr uint64_t SMALL_INPUT_SIZE = 4 * 1024 * 1024;
+
+}
+
+/**
+ * Checks whether an input is a regular file small enough to be signed at once.
+ */
+inline bool is_small_input(const std::string & name, uint64_t block_size)
+{
+   struct stat st;
+
+   if (stat(name.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+      return false;
+
+   return static_cast<uint64_t>(st.st_size) <= std::max(SMALL_INPUT_SIZE, block_size);
+}
+
+/**
+ * Signs a small input on the calling thread. The file is mapped, its blocks are hashed
+ * in batches of the hasher, and the whole output is made in memory and written by a single
+ * call. Neither buffers of blocks nor the thread pool are involved, so a signature takes
+ * about as long as hashing does. Digests are also given to the caller if it asks for them.
+ * Returns an empty string or a description of a problem with the input or the output.
+ */
+inline std::string sign_small_input(const std::string & input_name, std::ostream & output, output_format format,
+                             hash_algorithm algorithm, uint64_t block_size, std::vector<block_result> * digests = nullptr)
+{
+   mapped_file input;
+
+   if (!input.open(input_name, MADV_WILLNEED)) return std::string("can't map input file: ") + std::strerror(errno);
+
+   const block_hasher hasher { algorithm, block_size };
+   const size_t blocks_per_task = hasher.blocks_per_task();
+   // Empty file still gets a block.
+   const uint64_t block_count = std::max<uint64_t>(1, (input.size() + block_size - 1) / block_size);
+   static const uint8_t empty = 0;
+
+   std::ostringstream buffer;
+   signature_writer writer { buffer, format, algorithm, block_size, input_name };
+   std::vector<block_result> results;
+
+   writer.begin();
+
+   for (uint64_t first = 0; first < block_count; first += blocks_per_task)
+   {
+      const uint8_t * data[DIGEST_BATCH_SIZE];
+      size_t sizes[DIGEST_BATCH_SIZE];
+      block_digest batch[DIGEST_BATCH_SIZE];
+      size_t count = std::min<uint64_t>(blocks_per_task, block_count - first);
+
+      for (size_t i = 0; i < count; i++)
+      {
+         uint64_t offset = (first + i) * block_size;
+
+         data[i]  = input.size() != 0 ? input.data() + offset : &empty;
+         sizes[i] = std::min<uint64_t>(block_size, input.size() - offset);
+      }
+
+      hasher.hash(data, sizes, count, batch);
+
+      for (size_t i = 0; i < count; i++)
+         results.push_back({ batch[i], sizes[i] });
+   }
+
+   writer.write(results);
+   writer.finish(true);
+
+   const std::string signature = buffer.str();
+
+   output.write(signature.data(), signature.size());
+   output.flush();
+
+   if (!output.good()) return "can't write output file";
+   if (digests) *digests = std::move(results);
+   return std::string();
+}
+
+#endif /* SMALL_INPUT_HPP_ */
@@ -0,0 +1,150 @@
+/*
+ * stats.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: simonenkos
+ */
+
+#ifndef STATS_HPP_
+#define STATS_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+namespace
+{
+
+// Latencies are counted in buckets of a quarter of a power of two of microseconds.
+constexpr int LATENCY_BUCKETS_PER_OCTAVE = 4;
+constexpr int LATENCY_BUCKETS            = 40 * LATENCY_BUCKETS_PER_OCTAVE;
+
+}
+
+/**
+ * Histogram of latencies with logarithmic buckets, which are precise to about 20%
+ * and are updated without locks.
+ */
+class latency_histogram
+{
+   std::atomic<uint64_t> buckets_[LATENCY_BUCKETS];
+   std::atomic<uint64_t> count_;
+
+public:
+   latency_histogram() : count_(0)
+   {
+      for (auto & bucket : buckets_) bucket.store(0, std::memory_order_relaxed);
+   }
+
+   void add(std::chrono::steady_clock::duration latency)
+   {
+      double us = std::chrono::duration<double, std::micro>(latency).count();
+      int bucket = static_cast<int>(LATENCY_BUCKETS_PER_OCTAVE * std::log2(1.0 + us));
+
+      buckets_[std::min(std::max(bucket, 0), LATENCY_BUCKETS - 1)].fetch_add(1, std::memory_order_relaxed);
+      count_.fetch_add(1, std::memory_order_relaxed);
+   }
+
+   // Upper bound of latencies of a given share of samples, in milliseconds.
+   double percentile(double share) const
+   {
+      uint64_t count = count_.load(), seen = 0;
+
+      for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+      {
+         seen += buckets_[bucket].load();
+         if (count != 0 && seen >= share * count)
+            return (std::exp2(double(bucket + 1) / LATENCY_BUCKETS_PER_OCTAVE) - 1.0) / 1000.0;
+      }
+      return 0.0;
+   }
+};
+
+/**
+ * Statistics of the processing pipeline, printed at the end of a run with --stats.
+ */
+struct pipeline_stats
+{
+   // Largest distance between an id of a hashed block and the id of the first block
+   // which hasn't been hashed yet, and largest number of results held out of order.
+   std::atomic<uint64_t> max_reorder_distance     { 0 };
+   std::atomic<uint64_t> max_out_of_order_results { 0 };
+
+   // Speculative hashing of a straggling head block: how many times it was started
+   // and how many times it finished before the original task.
+   std::atomic<uint64_t> speculations     { 0 };
+   std::atomic<uint64_t> speculation_wins { 0 };
+
+   // Time tasks take to hash their blocks and time results take to be available,
+   // which is less with speculation.
+   latency_histogram task_latency;
+   latency_histogram result_latency;
+
+   // Steps of the autoscaler towards more and towards less workers or read-ahead,
+   // and both limits at the end, 0 is unlimited.
+   std::atomic<uint64_t> scale_ups   { 0 };
+   std::atomic<uint64_t> scale_downs { 0 };
+   std::atomic<uint64_t> workers     { 0 };
+   std::atomic<uint64_t> read_ahead  { 0 };
+
+   // Resources found in cgroup limits, which defaults are derived from; memory isn't limited with 0.
+   double   cpus          = 0;
+   uint64_t memory_budget = 0;
+
+   // Blocks found in the page cache and blocks read from storage with --cached-first.
+   uint64_t cached_blocks = 0;
+   uint64_t cold_blocks   = 0;
+   // Limit of distance in blocks, which blocks are read ahead of the oldest cold one by, and
+   // number of times a cold block has been read first because of it.
+   uint64_t reorder_limit  = 0;
+   uint64_t reorder_capped = 0;
+   // Blocks of zeros of a device with discard, which got a digest computed once.
+   std::atomic<uint64_t> zero_blocks { 0 };
+   // Extents of the input file read in order of their physical offsets with --physical-order,
+   // and blocks which digests have been taken from the extent cache instead of reading them.
+   uint64_t extents       = 0;
+   uint64_t reused_blocks = 0;
+
+   static void raise(std::atomic<uint64_t> & maximum, uint64_t value)
+   {
+      uint64_t current = maximum.load(std::memory_order_relaxed);
+
+      while (value > current && !maximum.compare_exchange_weak(current, value, std::memory_order_relaxed));
+   }
+
+   // Called for every result which is put aside till it's written.
+   void result_pending(uint64_t distance, uint64_t out_of_order)
+   {
+      raise(max_reorder_distance, distance);
+      raise(max_out_of_order_results, out_of_order);
+   }
+
+   void print() const
+   {
+      std::fprintf(stderr, "stats cpus=%.2f memory_budget=%llu\n", cpus, static_cast<unsigned long long>(memory_budget));
+      std::fprintf(stderr, "stats max_reorder_distance=%llu max_out_of_order_results=%llu\n",
+                   static_cast<unsigned long long>(max_reorder_distance.load()),
+                   static_cast<unsigned long long>(max_out_of_order_results.load()));
+      std::fprintf(stderr, "stats task_latency_p50_ms=%.3f task_latency_p99_ms=%.3f result_latency_p50_ms=%.3f result_latency_p99_ms=%.3f\n",
+                   task_latency.percentile(0.5), task_latency.percentile(0.99),
+                   result_latency.percentile(0.5), result_latency.percentile(0.99));
+      std::fprintf(stderr, "stats speculations=%llu speculation_wins=%llu\n",
+                   static_cast<unsigned long long>(speculations.load()),
+                   static_cast<unsigned long long>(speculation_wins.load()));
+      std::fprintf(stderr, "stats workers=%llu read_ahead=%llu scale_ups=%llu scale_downs=%llu\n",
+                   static_cast<unsigned long long>(workers.load()),
+                   static_cast<unsigned long long>(read_ahead.load()),
+                   static_cast<unsigned long long>(scale_ups.load()),
+                   static_cast<unsigned long long>(scale_downs.load()));
+      std::fprintf(stderr, "stats cached_blocks=%llu cold_blocks=%llu reorder_limit=%llu reorder_capped=%llu extents=%llu "
+                   "reused_blocks=%llu zero_blocks=%llu\n",
+                   static_cast<unsigned long long>(cached_blocks), static_cast<unsigned long long>(cold_blocks),
+                   static_cast<unsigned long long>(reorder_limit), static_cast<unsigned long long>(reorder_capped),
+                   static_cast<unsigned long long>(extents), static_cast<unsigned long long>(reused_blocks),
+                   static_cast<unsigned long long>(zero_blocks.load()));
+   }
+};
+
+#endif /* STATS_HPP_ */
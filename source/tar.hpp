@@ -0,0 +1,380 @@
+/*
+ * tar.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: simonenkos
+ */
+
+#ifndef TAR_HPP_
+#define TAR_HPP_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <ostream>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+
+#include "output_format.hpp"
+
+namespace
+{
+
+constexpr size_t TAR_BLOCK_SIZE = 512;
+
+// Type flags of tar headers which are handled by the reader.
+constexpr char TAR_REGULAR         = '0';
+constexpr char TAR_REGULAR_OLD     = '\0';
+constexpr char TAR_CONTIGUOUS      = '7';
+constexpr char TAR_PAX_HEADER      = 'x';
+constexpr char TAR_GNU_LONG_NAME   = 'L';
+
+// Limit of a size of extended headers, which are kept in memory.
+constexpr uint64_t TAR_MAX_EXTENDED_HEADER_SIZE = 1024 * 1024;
+
+}
+
+/**
+ * Regular file of a tar archive.
+ */
+struct tar_member
+{
+   std::string name;
+   uint64_t size;
+};
+
+/**
+ * Reader of tar archives (ustar, GNU and pax), which reads them strictly sequentially,
+ * so they can be read from pipes. Members other than regular files are skipped.
+ */
+class tar_reader
+{
+public:
+   // Function which reads size bytes of an archive, less of them only at its end.
+   using source = std::function<size_t(char *, size_t)>;
+
+private:
+   source source_;
+   uint64_t remaining_;
+   uint64_t padding_;
+   std::vector<char> skip_buffer_;
+
+   void read_exactly(char * data, size_t size)
+   {
+      if (source_(data, size) != size)
+         throw std::runtime_error("unexpected end of tar archive");
+   }
+
+   void skip(uint64_t size)
+   {
+      skip_buffer_.resize(64 * 1024);
+
+      while (size != 0)
+      {
+         size_t part = std::min<uint64_t>(size, skip_buffer_.size());
+         read_exactly(skip_buffer_.data(), part);
+         size -= part;
+      }
+   }
+
+   static uint64_t padding(uint64_t size)
+   {
+      return (TAR_BLOCK_SIZE - size % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE;
+   }
+
+   // Parses a numeric field, which is either octal or, for big values, base-256 with the high bit set.
+   static uint64_t parse_number(const char * field, size_t size)
+   {
+      uint64_t value = 0;
+
+      if (static_cast<unsigned char>(field[0]) & 0x80)
+      {
+         for (size_t i = 1; i < size; i++)
+            value = (value << 8) | static_cast<unsigned char>(field[i]);
+         return value;
+      }
+
+      size_t i = 0;
+      for (; i < size && field[i] == ' '; i++);
+      for (; i < size && field[i] >= '0' && field[i] <= '7'; i++)
+         value = value * 8 + (field[i] - '0');
+      return value;
+   }
+
+   static std::string parse_string(const char * field, size_t size)
+   {
+      return std::string(field, std::find(field, field + size, '\0'));
+   }
+
+   // Takes path and size from records of a pax extended header: "<length> <key>=<value>\n".
+   static void parse_pax(const std::vector<char> & data, std::string & path, uint64_t & size, bool & has_size)
+   {
+      for (size_t offset = 0; offset < data.size(); )
+      {
+         size_t length = 0, i = offset;
+
+         for (; i < data.size() && data[i] >= '0' && data[i] <= '9'; i++)
+            length = length * 10 + (data[i] - '0');
+
+         if (length == 0 || offset + length > data.size() || i >= data.size() || data[i] != ' ')
+            throw std::runtime_error("malformed pax header of tar archive");
+
+         std::string record(data.begin() + i + 1, data.begin() + offset + length - 1);
+         size_t equals = record.find('=');
+
+         if (equals != std::string::npos)
+         {
+            std::string key = record.substr(0, equals);
+
+            if (key == "path")
+               path = record.substr(equals + 1);
+            else if (key == "size")
+            {
+               size = std::stoull(record.substr(equals + 1));
+               has_size = true;
+            }
+         }
+         offset += length;
+      }
+   }
+
+public:
+   explicit tar_reader(source input) : source_(std::move(input)), remaining_(0), padding_(0)
+   { }
+
+   // Moves to the next regular file, skipping the rest of a current one. Returns false at
+   // the end of the archive. Throws std::runtime_error if the archive is malformed.
+   bool next(tar_member & member)
+   {
+      skip(remaining_ + padding_);
+      remaining_ = padding_ = 0;
+
+      std::string long_name;
+      uint64_t pax_size = 0;
+      bool has_pax_size = false;
+
+      while (true)
+      {
+         char header[TAR_BLOCK_SIZE];
+
+         // Archive ends with zero blocks, though some writers just stop.
+         if (source_(header, sizeof(header)) != sizeof(header))
+            return false;
+         if (std::all_of(header, header + sizeof(header), [](char c) { return c == 0; }))
+            return false;
+
+         // Checksum is a sum of bytes of the header with its own field taken as spaces.
+         uint64_t checksum = 0;
+
+         for (size_t i = 0; i < sizeof(header); i++)
+            checksum += (i >= 148 && i < 156) ? ' ' : static_cast<unsigned char>(header[i]);
+
+         if (checksum != parse_number(header + 148, 8))
+            throw std::runtime_error("wrong checksum of a tar header");
+
+         uint64_t size = parse_number(header + 124, 12);
+         char type = header[156];
+
+         if (type == TAR_PAX_HEADER || type == TAR_GNU_LONG_NAME)
+         {
+            if (size > TAR_MAX_EXTENDED_HEADER_SIZE)
+               throw std::runtime_error("extended header of tar archive is too big");
+
+            std::vector<char> data(size);
+            read_exactly(data.data(), data.size());
+            skip(padding(size));
+
+            if (type == TAR_GNU_LONG_NAME)
+               long_name = parse_string(data.data(), data.size());
+            else
+               parse_pax(data, long_name, pax_size, has_pax_size);
+            continue;
+         }
+
+         if (has_pax_size) size = pax_size;
+
+         if (type != TAR_REGULAR && type != TAR_REGULAR_OLD && type != TAR_CONTIGUOUS)
+         {
+            // Directories, links and devices have no data to sign, other
+            // types of headers are skipped together with their data.
+            skip(size + padding(size));
+            long_name.clear();
+            has_pax_size = false;
+            continue;
+         }
+
+         if (!long_name.empty())
+            member.name = long_name;
+         else
+         {
+            // Names of ustar archives are split to a prefix and a name.
+            std::string prefix = (std::memcmp(header + 257, "ustar", 5) == 0) ? parse_string(header + 345, 155) : "";
+            std::string name   = parse_string(header, 100);
+
+            member.name = prefix.empty() ? name : prefix + "/" + name;
+         }
+         member.size = size;
+
+         remaining_ = size;
+         padding_   = padding(size);
+         return true;
+      }
+   }
+
+   // Reads size bytes of data of a current member, less of them only at its end.
+   size_t read(char * data, size_t size)
+   {
+      size_t part = std::min<uint64_t>(size, remaining_);
+
+      read_exactly(data, part);
+      remaining_ -= part;
+      return part;
+   }
+
+   // Amount of data of a current member which hasn't been read yet.
+   uint64_t remaining() const
+   {
+      return remaining_;
+   }
+};
+
+/**
+ * Appends a string to a JSON document as a string value.
+ */
+inline void append_json_string(std::string & output, const std::string & value)
+{
+   static const char digits[] = "0123456789abcdef";
+
+   output.push_back('"');
+   for (unsigned char c : value)
+   {
+      if (c == '"' || c == '\\')
+      {
+         output.push_back('\\');
+         output.push_back(c);
+      }
+      else if (c < 0x20)
+      {
+         output.append("\\u00");
+         output.push_back(digits[c >> 4]);
+         output.push_back(digits[c & 0x0f]);
+      }
+      else output.push_back(c);
+   }
+   output.push_back('"');
+}
+
+/**
+ * Writer of signatures of members of a tar archive. Blocks of all members are numbered
+ * one after another by the pipeline, so results are split back to members here, each
+ * of them gets a signature of its own, numbered from zero, one after another in the
+ * output. The index gets a JSON line per member with its name, size, number of blocks,
+ * and offset and length of its signature in the output.
+ */
+class tar_signature_writer
+{
+   struct member_span
+   {
+      tar_member member;
+      uint64_t end_block;
+      bool ended;
+   };
+
+   signature_writer & writer_;
+   std::ostream & output_;
+   std::ostream & index_;
+
+   std::deque<member_span> members_;
+   bool started_;
+   uint64_t signature_offset_;
+   uint64_t next_block_;
+   std::vector<block_result> part_;
+   std::string text_;
+
+   void begin_member()
+   {
+      signature_offset_ = output_.tellp();
+      writer_.restart(members_.front().member.name);
+      writer_.disable_empty_block_trailer();
+      writer_.begin();
+      started_ = true;
+   }
+
+   void finish_member(bool complete)
+   {
+      writer_.finish(complete);
+
+      const auto & span = members_.front();
+
+      text_.assign("{\"name\":");
+      append_json_string(text_, span.member.name);
+      text_.append(",\"size\":");
+      append_decimal(text_, span.member.size);
+      text_.append(",\"blocks\":");
+      append_decimal(text_, writer_.blocks_written());
+      text_.append(",\"offset\":");
+      append_decimal(text_, signature_offset_);
+      text_.append(",\"length\":");
+      append_decimal(text_, static_cast<uint64_t>(output_.tellp()) - signature_offset_);
+      if (!complete) text_.append(",\"partial\":true");
+      text_.append("}\n");
+      index_.write(text_.data(), text_.size());
+
+      members_.pop_front();
+      started_ = false;
+   }
+
+public:
+   tar_signature_writer(signature_writer & writer, std::ostream & output, std::ostream & index)
+      : writer_(writer), output_(output), index_(index), started_(false), signature_offset_(0), next_block_(0)
+   { }
+
+   // Registers a member, which blocks follow blocks of a previous one.
+   void add_member(const tar_member & member)
+   {
+      members_.push_back({ member, 0, false });
+   }
+
+   // Marks the end of blocks of a last registered member, the given block is the first one after it.
+   void end_member(uint64_t end_block)
+   {
+      members_.back().end_block = end_block;
+      members_.back().ended = true;
+   }
+
+   // Writes results of blocks following the ones written before, splitting them by members.
+   void write(const std::vector<block_result> & batch)
+   {
+      for (size_t i = 0; i < batch.size(); )
+      {
+         if (!started_) begin_member();
+
+         const auto & span = members_.front();
+         size_t count = batch.size() - i;
+
+         if (span.ended)
+            count = std::min<uint64_t>(count, span.end_block - next_block_);
+
+         part_.assign(batch.begin() + i, batch.begin() + i + count);
+         writer_.write(part_);
+         i += count;
+         next_block_ += count;
+
+         if (span.ended && next_block_ == span.end_block)
+            finish_member(true);
+      }
+   }
+
+   // Finishes the output, a member which hasn't been written completely is marked as partial.
+   void finish(bool complete)
+   {
+      if (started_) finish_member(complete);
+
+      output_.flush();
+      index_.flush();
+   }
+};
+
+#endif /* TAR_HPP_ */
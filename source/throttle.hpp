@@ -0,0 +1,264 @@
+/*
+ * throttle.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: simonenkos
+ */
+
+#ifndef THROTTLE_HPP_
+#define THROTTLE_HPP_
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include <boost/any.hpp>
+#include <boost/regex.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/program_options.hpp>
+
+namespace
+{
+
+// Definitions of linux/ioprio.h, which isn't exported by all C libraries.
+constexpr int IOPRIO_WHO_PROCESS  = 1;
+constexpr int IOPRIO_CLASS_SHIFT  = 13;
+constexpr int IOPRIO_CLASS_BE     = 2;
+constexpr int IOPRIO_CLASS_IDLE   = 3;
+constexpr int IOPRIO_BE_LOWEST    = 7;
+
+// Pressure (share of time some tasks stall, in percents) above which
+// the throttle backs off and below which it speeds up again.
+constexpr double PSI_HIGH_PRESSURE = 10.0;
+constexpr double PSI_LOW_PRESSURE  = 2.0;
+constexpr double PSI_MIN_SCALE     = 0.05;
+constexpr int    PSI_POLL_MS       = 1000;
+
+}
+
+/**
+ * Amount of bytes per second, which consists of a numeric part and an optional
+ * K (kilobytes), M (megabytes) or G (gigabytes) suffix.
+ */
+struct data_rate
+{
+   uint64_t bytes_per_second;
+};
+
+/**
+ * Overload function for validation of data_rate values needed for boost::program_options.
+ */
+inline void validate(boost::any & value, const std::vector<std::string> & string_values, data_rate * target_type, int)
+{
+   namespace bpo = boost::program_options;
+   static const boost::regex r("(^\\d+)([K|M|G]?$)");
+
+   bpo::validators::check_first_occurrence(value);
+   boost::smatch match;
+
+   if (regex_match(bpo::validators::get_single_string(string_values), match, r))
+   {
+      uint64_t number;
+
+      try
+      {
+         number = boost::lexical_cast<uint64_t>(match[1]);
+      }
+      catch (boost::bad_lexical_cast & e)
+      {
+         throw bpo::validation_error
+         (
+               bpo::validation_error::invalid_option_value
+         );
+      }
+
+      uint64_t multiplier = 1;
+      std::string suffix = match[2];
+
+      if (!suffix.empty())
+         multiplier = (suffix[0] == 'K') ? 1024 : (suffix[0] == 'M') ? 1024 * 1024 : 1024 * 1024 * 1024;
+
+      if (number != 0 && std::numeric_limits<uint64_t>::max() / multiplier >= number)
+      {
+         value = boost::any(data_rate { number * multiplier });
+         return;
+      }
+   }
+   throw bpo::validation_error
+   (
+         bpo::validation_error::invalid_option_value
+   );
+}
+
+/**
+ * Sets I/O scheduling class of the calling thread, which is inherited by threads
+ * created after it. Accepts "idle", "best-effort" and "best-effort:<0-7>".
+ */
+inline bool set_io_priority(const std::string & priority)
+{
+   int value;
+
+   if (priority == "idle")
+   {
+      value = IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT;
+   }
+   else if (priority.compare(0, 11, "best-effort") == 0)
+   {
+      int level = IOPRIO_BE_LOWEST;
+
+      if (priority.size() > 11)
+      {
+         if (priority.size() != 13 || priority[11] != ':' || priority[12] < '0' || priority[12] > '7')
+            return false;
+         level = priority[12] - '0';
+      }
+      value = (IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT) | level;
+   }
+   else return false;
+
+   return syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, value) == 0;
+}
+
+/**
+ * Reads "some avg10" value of a Linux pressure stall information file.
+ * Returns a negative value if the file isn't available.
+ */
+inline double read_pressure(const char * path)
+{
+   std::ifstream file { path };
+   std::string line;
+
+   while (std::getline(file, line))
+   {
+      std::istringstream fields { line };
+      std::string kind, average;
+
+      if (fields >> kind >> average && kind == "some" && average.compare(0, 6, "avg10=") == 0)
+         return std::atof(average.c_str() + 6);
+   }
+   return -1;
+}
+
+/**
+ * Limits resources consumed by processing: read bandwidth with a token bucket,
+ * CPU time of hashing tasks with duty cycling, i.e. sleeping in proportion to
+ * the time spent working. Optionally follows system pressure reported by PSI,
+ * scaling both limits down when I/O or CPU are stressed and back up when idle.
+ */
+class throttle
+{
+   uint64_t max_read_rate_;
+   unsigned max_cpu_percent_;
+   bool adaptive_;
+
+   // Token bucket of the reader, it's used by a single thread only.
+   double tokens_;
+   std::chrono::steady_clock::time_point last_refill_;
+
+   // Share of configured limits allowed by current system pressure.
+   std::atomic<double> scale_;
+
+   std::mutex mutex_;
+   std::condition_variable stop_requested_;
+   bool stopped_;
+   std::thread monitor_;
+
+   void monitor()
+   {
+      std::unique_lock<std::mutex> lock(mutex_);
+
+      while (!stop_requested_.wait_for(lock, std::chrono::milliseconds(PSI_POLL_MS), [this]() { return stopped_; }))
+      {
+         double pressure = std::max(read_pressure("/proc/pressure/io"), read_pressure("/proc/pressure/cpu"));
+         double scale = scale_.load();
+
+         if      (pressure > PSI_HIGH_PRESSURE) scale = std::max(PSI_MIN_SCALE, scale / 2);
+         else if (pressure < PSI_LOW_PRESSURE)  scale = std::min(1.0, scale * 1.25);
+
+         scale_.store(scale);
+      }
+   }
+
+   static void duty_cycle(std::chrono::steady_clock::duration busy, double percent)
+   {
+      if (percent >= 100) return;
+      std::this_thread::sleep_for(busy * ((100 - percent) / percent));
+   }
+
+public:
+   throttle(uint64_t max_read_rate, unsigned max_cpu_percent)
+      : max_read_rate_(max_read_rate), max_cpu_percent_(max_cpu_percent), adaptive_(false), tokens_(0),
+        last_refill_(std::chrono::steady_clock::now()), scale_(1.0), stopped_(false)
+   { }
+
+   ~throttle()
+   {
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+         stopped_ = true;
+      }
+      stop_requested_.notify_all();
+      if (monitor_.joinable()) monitor_.join();
+   }
+
+   // Starts following of pressure stall information, returns false if it's not supported.
+   bool adapt_to_pressure()
+   {
+      if (read_pressure("/proc/pressure/io") < 0 || read_pressure("/proc/pressure/cpu") < 0)
+         return false;
+
+      adaptive_ = true;
+      monitor_ = std::thread(&throttle::monitor, this);
+      return true;
+   }
+
+   // Called by the reader after a block has been read during a given time.
+   void block_read(uint64_t size, std::chrono::steady_clock::duration read_time)
+   {
+      double scale = scale_.load(std::memory_order_relaxed);
+
+      if (max_read_rate_ != 0)
+      {
+         double rate = max_read_rate_ * scale;
+         auto now = std::chrono::steady_clock::now();
+
+         // Refill the bucket, allowing a burst of at most a tenth of a second.
+         tokens_ = std::min(rate / 10, tokens_ + rate * std::chrono::duration<double>(now - last_refill_).count());
+         last_refill_ = now;
+
+         // Blocks may be larger than the bucket, so go into debt and wait it off.
+         tokens_ -= size;
+         if (tokens_ < 0)
+            std::this_thread::sleep_for(std::chrono::duration<double>(-tokens_ / rate));
+      }
+      else if (adaptive_)
+      {
+         // Without an explicit rate the pressure can only slow the reader down by duty cycling.
+         duty_cycle(read_time, 100 * scale);
+      }
+   }
+
+   // Called by a hashing task after it has been working for a given time.
+   void block_hashed(std::chrono::steady_clock::duration busy_time)
+   {
+      double percent = max_cpu_percent_ ? max_cpu_percent_ : 100;
+
+      if (adaptive_) percent *= scale_.load(std::memory_order_relaxed);
+
+      duty_cycle(busy_time, percent);
+   }
+};
+
+#endif /* THROTTLE_HPP_ */
@@ -0,0 +1,380 @@
+/*
+ * xattr_cache.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: simonenkos
+ */
+
+#ifndef XATTR_CACHE_HPP_
+#define XATTR_CACHE_HPP_
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+
+#include "digest.hpp"
+#include "output_format.hpp"
+
+namespace
+{
+
+constexpr char XATTR_MAGIC[8] = { 'S', 'I', 'G', 'X', 'A', 'T', 'T', '3' };
+constexpr char XATTR_SEAL_MAGIC[8] = { 'S', 'I', 'G', 'S', 'E', 'A', 'L', '1' };
+// Prefix of names of attributes, a signature of each algorithm and block size has one of its own.
+constexpr const char * XATTR_NAME_PREFIX = "user.signature.";
+// Digests are stored in the attribute up to this size of its value, in a sidecar file otherwise.
+// File systems keep small attributes within the inode or a single block with all the others.
+constexpr size_t XATTR_INLINE_SIZE = 2048;
+// File which has been modified this recently when it's started to be read may still be
+// modified within the same tick of timestamps without its mtime changing, so it isn't sealed.
+constexpr int64_t XATTR_RACY_WINDOW_NS = 2000000000;
+// Setting an attribute changes ctime of the file to a time around the moment of sealing:
+// a bit earlier, since the kernel takes timestamps from a coarse clock, or a bit later.
+constexpr int64_t XATTR_CLOCK_SLACK_NS = 20000000;
+constexpr int64_t XATTR_SEAL_WINDOW_NS = 100000000;
+
+}
+
+/**
+ * Value of an attribute: a header, which is followed by digests themselves or by a name
+ * of a sidecar file holding them. All fields are 8 bytes, so there is no padding.
+ */
+struct xattr_header
+{
+   char magic[8];
+   uint64_t algorithm;
+   uint64_t block_size;
+   uint64_t block_count;
+   // Validity tuple: the file with this content is the same inode of this size and mtime,
+   // which ctime is the one of the seal of the sidecar file, or which ctime hasn't changed
+   // since the attribute has been set at the sealing time, if there is no sidecar file.
+   uint64_t device;
+   uint64_t inode;
+   uint64_t size;
+   int64_t mtime_sec;
+   int64_t mtime_nsec;
+   int64_t sealed_sec;
+   int64_t sealed_nsec;
+   // Digests are in the sidecar file after its seal, they have this SHA-256.
+   uint64_t sidecar;
+   uint8_t sidecar_digest[SHA256_DIGEST_SIZE];
+};
+
+/**
+ * Seal of an attribute, which begins its sidecar file: ctime of the file right after the
+ * attribute has been set. Digests, which don't fit into the attribute, follow it.
+ */
+struct xattr_seal
+{
+   char magic[8];
+   int64_t ctime_sec;
+   int64_t ctime_nsec;
+};
+
+inline int64_t timespec_ns(const struct timespec & time)
+{
+   return static_cast<int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+/**
+ * Signature of a file kept in an extended attribute of the file itself, so a later run or
+ * any other tool gets it with a single getxattr() instead of hashing the file once more.
+ * Digests of large files are kept in a sidecar file next to it, the attribute names it.
+ *
+ * Stale digests must never be returned, so a signature is trusted only while each part
+ * of the validity tuple matches the file: its inode, size and mtime, and also its ctime,
+ * which can't be set by users and changes on any modification, even one which restores
+ * mtime afterwards. Setting the attribute changes ctime itself, and so would setting one
+ * more. So the exact ctime, which is taken after the attribute is set, is kept in a seal
+ * at the beginning of the sidecar file; a signature without one holds the moment of
+ * sealing instead, and ctime has to be within a narrow window around it.
+ *
+ * A signature is sealed only if the file hasn't changed while it's been read, which is
+ * checked by its state before and after, and hasn't been modified for a while before it,
+ * since modifications within the same tick of timestamps leave mtime as it is. The file
+ * is checked once more after the attribute is set, but ctime can't be told from the one
+ * set by the attribute, so a write and a utimensat() restoring mtime in the moment between
+ * the checks, or within the window of a signature without a sidecar file, aren't noticed.
+ */
+class xattr_signature_cache
+{
+   std::string path_;
+   std::string attribute_;
+   hash_algorithm algorithm_;
+   uint64_t block_size_;
+
+   // State of the file before it's been read, and the time it's been taken at.
+   struct stat before_;
+   struct timespec started_;
+   bool begun_;
+
+   uint64_t block_count(uint64_t size) const
+   {
+      // Empty file still gets a block.
+      return std::max<uint64_t>(1, (size + block_size_ - 1) / block_size_);
+   }
+
+   // Sidecar file is kept next to the file, hidden.
+   std::string sidecar_name() const
+   {
+      size_t slash = path_.rfind('/');
+      std::string base = slash == std::string::npos ? path_ : path_.substr(slash + 1);
+
+      return "." + base + "." + hash_algorithm_name(algorithm_) + "." + std::to_string(block_size_) + ".sig";
+   }
+
+   std::string sidecar_path(const std::string & name) const
+   {
+      size_t slash = path_.rfind('/');
+
+      return slash == std::string::npos ? name : path_.substr(0, slash + 1) + name;
+   }
+
+   // Compares states of the file but their ctime.
+   static bool same_but_ctime(const struct stat & first, const struct stat & second)
+   {
+      return first.st_dev == second.st_dev && first.st_ino == second.st_ino && first.st_size == second.st_size &&
+             first.st_mtim.tv_sec == second.st_mtim.tv_sec && first.st_mtim.tv_nsec == second.st_mtim.tv_nsec &&
+             first.st_mode == second.st_mode && first.st_nlink == second.st_nlink && first.st_uid == second.st_uid &&
+             first.st_gid == second.st_gid;
+   }
+
+   static bool same_content(const struct stat & first, const struct stat & second)
+   {
+      return same_but_ctime(first, second) &&
+             first.st_ctim.tv_sec == second.st_ctim.tv_sec && first.st_ctim.tv_nsec == second.st_ctim.tv_nsec;
+   }
+
+   // Checks ctime of the file without a sidecar file against the moment of sealing.
+   static bool within_seal_window(const xattr_header & header, const struct stat & st)
+   {
+      int64_t sealed = header.sealed_sec * 1000000000 + header.sealed_nsec;
+      int64_t changed = timespec_ns(st.st_ctim);
+
+      return changed >= sealed - XATTR_CLOCK_SLACK_NS && changed <= sealed + XATTR_SEAL_WINDOW_NS;
+   }
+
+   // Checks the validity tuple of a header against a state of the file but its ctime.
+   bool valid(const xattr_header & header, const struct stat & st) const
+   {
+      return std::memcmp(header.magic, XATTR_MAGIC, sizeof(XATTR_MAGIC)) == 0 &&
+             header.algorithm == static_cast<uint64_t>(algorithm_) && header.block_size == block_size_ &&
+             header.device == static_cast<uint64_t>(st.st_dev) && header.inode == static_cast<uint64_t>(st.st_ino) &&
+             header.size == static_cast<uint64_t>(st.st_size) && header.block_count == block_count(st.st_size) &&
+             header.mtime_sec == st.st_mtim.tv_sec && header.mtime_nsec == st.st_mtim.tv_nsec;
+   }
+
+   // Writes a seal and digests to a sidecar file, replacing it at once, so it's never seen half written.
+   bool write_sidecar(const std::string & data, std::string & error) const
+   {
+      std::string path = sidecar_path(sidecar_name());
+      std::string temporary = path + ".tmp";
+      std::ofstream file { temporary, std::ios::binary | std::ios::trunc };
+
+      file.write(data.data(), data.size());
+      file.close();
+
+      if (!file || std::rename(temporary.c_str(), path.c_str()) != 0)
+      {
+         error = "can't write sidecar file " + path;
+         std::remove(temporary.c_str());
+         return false;
+      }
+      return true;
+   }
+
+public:
+   xattr_signature_cache(const std::string & path, hash_algorithm algorithm, uint64_t block_size) :
+      path_(path), attribute_(XATTR_NAME_PREFIX + std::string(hash_algorithm_name(algorithm)) + "." + std::to_string(block_size)),
+      algorithm_(algorithm), block_size_(block_size), before_(), started_(), begun_(false)
+   { }
+
+   // Loads a signature of the file, returns false if there is no valid one.
+   bool load(std::vector<block_result> & results) const
+   {
+      int fd = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+
+      if (fd == -1) return false;
+
+      // The attribute and the state are taken from the same open file, not by a path twice.
+      std::vector<char> value(XATTR_INLINE_SIZE);
+      ssize_t size = fgetxattr(fd, attribute_.c_str(), value.data(), value.size());
+      struct stat st;
+      bool found = size >= static_cast<ssize_t>(sizeof(xattr_header)) && fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+
+      ::close(fd);
+      if (!found) return false;
+
+      xattr_header header;
+      std::memcpy(&header, value.data(), sizeof(header));
+
+      if (!valid(header, st)) return false;
+
+      const size_t digest_bytes = digest_size(algorithm_);
+      std::string digests(value.data() + sizeof(header), size - sizeof(header));
+
+      if (!header.sidecar && !within_seal_window(header, st)) return false;
+      if (header.sidecar)
+      {
+         // Only a name within the directory of the file is followed.
+         if (digests.empty() || digests.find('/') != std::string::npos) return false;
+
+         std::ifstream file { sidecar_path(digests), std::ios::binary };
+         std::string sidecar { std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+         uint8_t checksum[SHA256_DIGEST_SIZE];
+         xattr_seal seal;
+
+         if (sidecar.size() < sizeof(seal)) return false;
+         std::memcpy(&seal, sidecar.data(), sizeof(seal));
+
+         if (std::memcmp(seal.magic, XATTR_SEAL_MAGIC, sizeof(XATTR_SEAL_MAGIC)) != 0 ||
+             seal.ctime_sec != st.st_ctim.tv_sec || seal.ctime_nsec != st.st_ctim.tv_nsec)
+            return false;
+
+         digests.assign(sidecar, sizeof(seal), std::string::npos);
+         sha256(reinterpret_cast<const uint8_t *>(digests.data()), digests.size(), checksum);
+
+         if (std::memcmp(checksum, header.sidecar_digest, sizeof(checksum)) != 0) return false;
+      }
+      if (digests.size() != header.block_count * digest_bytes) return false;
+
+      results.clear();
+      results.reserve(header.block_count);
+
+      for (uint64_t i = 0; i < header.block_count; i++)
+      {
+         block_result result {};
+
+         std::memcpy(result.digest.bytes, digests.data() + i * digest_bytes, digest_bytes);
+         result.length = std::min<uint64_t>(block_size_, header.size - i * block_size_);
+         results.push_back(result);
+      }
+      return true;
+   }
+
+   // Takes the state of the file before it's read.
+   void begin()
+   {
+      clock_gettime(CLOCK_REALTIME, &started_);
+      begun_ = stat(path_.c_str(), &before_) == 0 && S_ISREG(before_.st_mode);
+   }
+
+   // Stores a signature of the file which has been read since begin(). Returns false and
+   // sets a reason if it's not stored, since the file may have changed meanwhile.
+   bool store(const std::vector<block_result> & results, std::string & error) const
+   {
+      struct stat after;
+
+      if (!begun_ || stat(path_.c_str(), &after) != 0 || !same_content(before_, after) ||
+          results.size() != block_count(after.st_size))
+      {
+         error = "input file has changed while it's been read";
+         return false;
+      }
+      if (timespec_ns(after.st_mtim) >= timespec_ns(started_) - XATTR_RACY_WINDOW_NS)
+      {
+         error = "input file has been modified too recently";
+         return false;
+      }
+
+      const size_t digest_bytes = digest_size(algorithm_);
+      std::string digests;
+
+      digests.reserve(results.size() * digest_bytes);
+      for (const auto & result : results)
+         digests.append(reinterpret_cast<const char *>(result.digest.bytes), digest_bytes);
+
+      xattr_header header {};
+
+      std::memcpy(header.magic, XATTR_MAGIC, sizeof(XATTR_MAGIC));
+      header.algorithm   = static_cast<uint64_t>(algorithm_);
+      header.block_size  = block_size_;
+      header.block_count = results.size();
+      header.device      = after.st_dev;
+      header.inode       = after.st_ino;
+      header.size        = after.st_size;
+      header.mtime_sec   = after.st_mtim.tv_sec;
+      header.mtime_nsec  = after.st_mtim.tv_nsec;
+
+      std::string payload = digests;
+
+      if (sizeof(header) + digests.size() > XATTR_INLINE_SIZE)
+      {
+         header.sidecar = 1;
+         sha256(reinterpret_cast<const uint8_t *>(digests.data()), digests.size(), header.sidecar_digest);
+         payload = sidecar_name();
+      }
+
+      int fd = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+      struct stat sealed;
+      struct timespec now;
+
+      if (fd == -1)
+      {
+         error = std::strerror(errno);
+         return false;
+      }
+
+      clock_gettime(CLOCK_REALTIME, &now);
+      header.sealed_sec  = now.tv_sec;
+      header.sealed_nsec = now.tv_nsec;
+
+      std::string value(reinterpret_cast<const char *>(&header), sizeof(header));
+      value += payload;
+
+      if (fsetxattr(fd, attribute_.c_str(), value.data(), value.size(), 0) != 0)
+      {
+         error = std::strerror(errno);
+         ::close(fd);
+         return false;
+      }
+
+      // The file must still be the one which has been read, but for ctime set by the attribute,
+      // otherwise the attribute is taken back.
+      if (fstat(fd, &sealed) != 0 || !valid(header, sealed) || !same_but_ctime(after, sealed) ||
+          (!header.sidecar && !within_seal_window(header, sealed)))
+      {
+         fremovexattr(fd, attribute_.c_str());
+         error = "input file has changed while it's been sealed";
+         ::close(fd);
+         return false;
+      }
+      if (!header.sidecar)
+      {
+         ::close(fd);
+         return true;
+      }
+
+      // The ctime is sealed in the sidecar file, any later change leaves it behind.
+      xattr_seal seal;
+
+      std::memcpy(seal.magic, XATTR_SEAL_MAGIC, sizeof(XATTR_SEAL_MAGIC));
+      seal.ctime_sec  = sealed.st_ctim.tv_sec;
+      seal.ctime_nsec = sealed.st_ctim.tv_nsec;
+
+      std::string sidecar(reinterpret_cast<const char *>(&seal), sizeof(seal));
+
+      sidecar += digests;
+      if (!write_sidecar(sidecar, error))
+      {
+         fremovexattr(fd, attribute_.c_str());
+         ::close(fd);
+         return false;
+      }
+      ::close(fd);
+      return true;
+   }
+};
+
+#endif /* XATTR_CACHE_HPP_ */